@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <complex.h>
+#include <math.h>
+#include "pgm.h"
+
+// Compara duas imagens do mesmo tamanho, por exemplo a ifft.pgm gerada pela
+// versao em precisao dupla (referencia) e pela versao compilada com -DFFT_FLOAT
+int main(int argc, char** argv){
+
+    if(argc != 3){
+        printf("Uso: %s <referencia.pgm> <imagem.pgm>\n", argv[0]);
+        return 1;
+    }
+
+    pgm_t ref = pgm_read(argv[1]);
+    pgm_t img = pgm_read(argv[2]);
+
+    if(ref.width != img.width || ref.height != img.height){
+        printf("As imagens tem tamanhos diferentes\n");
+        return 1;
+    }
+
+    double max_err = 0, sum_err = 0, sum_sq = 0;
+    long differing = 0;
+    long pixels = (long)ref.width * ref.height;
+
+    for(int i = 0; i < ref.height; i++){
+        for(int j = 0; j < ref.width; j++){
+            double err = fabs(creal(img.data[i][j]) - creal(ref.data[i][j]));
+
+            if(err > max_err) max_err = err;
+            if(err > 0) differing++;
+
+            sum_err += err;
+            sum_sq += err * err;
+        }
+    }
+
+    double rmse = sqrt(sum_sq / pixels);
+
+    printf("Pixels: %ld\n", pixels);
+    printf("Max error: %.0lf gray levels\n", max_err);
+    printf("Mean error: %.6lf gray levels\n", sum_err / pixels);
+    printf("RMSE: %.6lf gray levels\n", rmse);
+    if(rmse > 0){
+        printf("PSNR: %.2lf dB\n", 20 * log10(ref.max / rmse));
+    } else {
+        printf("PSNR: inf\n");
+    }
+    printf("Differing pixels: %ld (%.4lf%%)\n", differing, 100.0 * differing / pixels);
+
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef CODELETS_H_
+#define CODELETS_H_
+
+#include "pgm.h"
+
+// Unrolled transform of a fixed size on input in bit-reversed order
+typedef void (*codelet_fn)(cplx*);
+
+typedef struct codelet{
+    int n;
+    codelet_fn forward;
+    codelet_fn inverse;
+}codelet_t;
+
+// Generated by gen_codelets.c, sorted by size
+extern const codelet_t fft_codelets[];
+extern const int fft_num_codelets;
+
+#endif
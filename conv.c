@@ -0,0 +1,352 @@
+#include "conv.h"
+#include "fft_plan.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// 2D convolution and correlation of an image with a spatial kernel.
+// The output has the size of the image, with the kernel centered at
+// (kw / 2, kh / 2) and zeros outside the image:
+// convolution: out[y][x] = sum image[y + cy - i][x + cx - j] * kernel[i][j]
+// correlation: out[y][x] = sum image[y - cy + i][x - cx + j] * kernel[i][j]
+
+static int _pow2(int num){
+    int power = 1;
+    while(power < num){
+        power *= 2;
+    }
+    return power;
+}
+
+// Function to choose between the direct and the FFT methods
+// The direct method costs 2 flops per pixel and kernel element; the FFT method
+// costs two complex 2D transforms of the padded size and the product of the spectra
+// width, height = size of the image
+// kw, kh = size of the kernel
+// return = CONV_DIRECT or CONV_FFT
+int conv2d_choose(int width, int height, int kw, int kh){
+    double direct = 2.0 * width * height * kw * kh;
+
+    double n = (double)_pow2(width + kw - 1) * _pow2(height + kh - 1);
+    double fft = 2 * 5.0 * n * log2(n) + 16 * n;
+
+    return (direct <= fft) ? CONV_DIRECT : CONV_FFT;
+}
+
+// Function to convolve or correlate an image with a kernel directly
+// image = height rows of width pixels
+// kernel = kh rows of kw elements
+// correlate = 0 for the convolution, 1 for the correlation
+// out = height rows of width values
+void conv2d_direct(const real_t* image, int width, int height, const real_t* kernel, int kw, int kh, int correlate, real_t* out){
+    int cx = kw / 2;
+    int cy = kh / 2;
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int y = 0; y < height; y++){
+        for(int x = 0; x < width; x++){
+            double sum = 0;
+
+            for(int i = 0; i < kh; i++){
+                int yy = (correlate) ? y - cy + i : y + cy - i;
+                if(yy < 0 || yy >= height) continue;
+
+                for(int j = 0; j < kw; j++){
+                    int xx = (correlate) ? x - cx + j : x + cx - j;
+                    if(xx < 0 || xx >= width) continue;
+
+                    sum += image[(size_t)yy * width + xx] * kernel[i * kw + j];
+                }
+            }
+
+            out[(size_t)y * width + x] = sum;
+        }
+    }
+}
+
+// Function to multiply the spectra of the image and of the kernel, both in one
+// transform of image + i * kernel
+// With Z the transform and Z' = conj(Z(-k)), the spectra are
+// X = (Z + Z') / 2 and K = (Z - Z') / 2i
+// t = transform, pw rows of ph elements (the transposed layout of fft_execute_2d)
+// out = X * K, or X * conj(K) for the correlation, in the same layout
+static void _spectra_product(const cplx* t, cplx* out, int pw, int ph, int correlate){
+    const real_t* z = (const real_t*)t;
+    real_t* p = (real_t*)out;
+    real_t ksign = (correlate) ? -1 : 1;
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int r = 0; r < pw; r++){
+        int r2 = (pw - r) % pw;
+
+        for(int c = 0; c < ph; c++){
+            int c2 = (ph - c) % ph;
+            size_t a = 2 * ((size_t)r * ph + c);
+            size_t b = 2 * ((size_t)r2 * ph + c2);
+
+            real_t zr = z[a], zi = z[a + 1];
+            real_t mr = z[b], mi = -z[b + 1];
+
+            real_t xr = (zr + mr) / 2;
+            real_t xi = (zi + mi) / 2;
+            real_t kr = (zi - mi) / 2;
+            real_t ki = ksign * (mr - zr) / 2;
+
+            p[a] = xr * kr - xi * ki;
+            p[a + 1] = xr * ki + xi * kr;
+        }
+    }
+}
+
+// Function to convolve or correlate an image with a kernel with FFTs
+// Both are padded with zeros to powers of 2 big enough for the linear
+// convolution, so nothing wraps around
+// image, width, height, kernel, kw, kh, correlate, out = see conv2d_direct
+// plan_mode = FFT_MEASURE or FFT_ESTIMATE
+void conv2d_fft(const real_t* image, int width, int height, const real_t* kernel, int kw, int kh, int correlate, int plan_mode, real_t* out){
+    int pw = _pow2(width + kw - 1);
+    int ph = _pow2(height + kh - 1);
+    int cx = kw / 2;
+    int cy = kh / 2;
+
+    fft_plan_t* row_plan = fft_plan_create(pw, plan_mode);
+    fft_plan_t* col_plan = (ph == pw) ? row_plan : fft_plan_create(ph, plan_mode);
+
+    size_t size = (size_t)pw * ph;
+    cplx* v = (cplx*)calloc(size, sizeof(cplx));
+    cplx* t = (cplx*)malloc(size * sizeof(cplx));
+
+    // Image in the real part and kernel in the imaginary part
+    real_t* d = (real_t*)v;
+    for(int y = 0; y < height; y++){
+        for(int x = 0; x < width; x++){
+            d[2 * ((size_t)y * pw + x)] = image[(size_t)y * width + x];
+        }
+    }
+    for(int i = 0; i < kh; i++){
+        for(int j = 0; j < kw; j++){
+            d[2 * ((size_t)i * pw + j) + 1] = kernel[i * kw + j];
+        }
+    }
+
+    int live_rows = (height > kh) ? height : kh;
+    fft_execute_2d(row_plan, col_plan, v, t, live_rows, 0);
+
+    _spectra_product(t, v, pw, ph, correlate);
+
+    // The convolution only needs the rows cy to cy + height - 1, the
+    // correlation wraps around at the top
+    int out_rows = (correlate) ? ph : cy + height;
+    fft_execute_2d(row_plan, col_plan, v, t, out_rows, 1);
+
+    double scale = 1.0 / ((double)pw * ph);
+    int dy = (correlate) ? ph - cy : cy;
+    int dx = (correlate) ? pw - cx : cx;
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int y = 0; y < height; y++){
+        const cplx* row = t + (size_t)((y + dy) % ph) * pw;
+        for(int x = 0; x < width; x++){
+            out[(size_t)y * width + x] = creal(row[(x + dx) % pw]) * scale;
+        }
+    }
+
+    free(v);
+    free(t);
+    if(col_plan != row_plan) fft_plan_destroy(col_plan);
+    fft_plan_destroy(row_plan);
+}
+
+// Function to convolve or correlate an image with a kernel
+// image, width, height, kernel, kw, kh, correlate, out = see conv2d_direct
+// method = CONV_AUTO, CONV_DIRECT or CONV_FFT
+// plan_mode = FFT_MEASURE or FFT_ESTIMATE
+// return = method used
+int conv2d(const real_t* image, int width, int height, const real_t* kernel, int kw, int kh, int correlate, int method, int plan_mode, real_t* out){
+    if(method == CONV_AUTO){
+        method = conv2d_choose(width, height, kw, kh);
+    }
+
+    if(method == CONV_DIRECT){
+        conv2d_direct(image, width, height, kernel, kw, kh, correlate, out);
+    } else {
+        conv2d_fft(image, width, height, kernel, kw, kh, correlate, plan_mode, out);
+    }
+
+    return method;
+}
+
+// Cost of the tiled method per output pixel: a complex 2D transform of a
+// tile and its inverse cover two tiles of (tile - kw + 1) x (tile - kh + 1)
+static double _tile_cost(int tile, int kw, int kh){
+    double n = (double)tile * tile;
+    return (5.0 * n * log2(n) + 8 * n) / ((double)(tile - kw + 1) * (tile - kh + 1));
+}
+
+// Function to choose the tile size of the tiled method
+// Tiles at least 4 times bigger than the kernel waste little on the overlap;
+// bigger tiles are used while they are cheaper per pixel and the two buffers
+// of a thread still fit in the L2 cache
+// kw, kh = size of the kernel
+// return = size of the tiles
+int conv_tile_size(int kw, int kh){
+    int k = (kw > kh) ? kw : kh;
+    int best = _pow2(4 * (k - 1));
+    if(best < 32) best = 32;
+
+    long l2 = fft_l2_bytes();
+    for(int tile = 2 * best; tile <= 4096 && 2 * (long)tile * tile * (long)sizeof(cplx) <= l2; tile *= 2){
+        if(_tile_cost(tile, kw, kh) < _tile_cost(best, kw, kh)){
+            best = tile;
+        }
+    }
+
+    return best;
+}
+
+// Function to prepare the tiled convolution or correlation of images of a width
+// The spectrum of the kernel is computed once. The correlation is the
+// convolution with the flipped kernel
+// width = width of the images
+// kernel, kw, kh, correlate = see conv2d_direct
+// tile = size of the tiles, a power of 2 not smaller than the kernel, 0 to choose it
+// plan_mode = FFT_MEASURE or FFT_ESTIMATE
+// return = tiler, NULL if the tile size is not valid
+conv_tiler_t* conv_tiler_create(int width, const real_t* kernel, int kw, int kh, int correlate, int tile, int plan_mode){
+    if(tile == 0){
+        tile = conv_tile_size(kw, kh);
+    }
+    if(tile != _pow2(tile) || tile < kw || tile < kh){
+        return NULL;
+    }
+
+    conv_tiler_t* t = (conv_tiler_t*)malloc(sizeof(conv_tiler_t));
+    t->width = width;
+    t->kh = kh;
+    t->tile = tile;
+    t->band = tile - kh + 1;
+    t->cols = tile - kw + 1;
+    t->up = (correlate) ? kh / 2 : kh - 1 - kh / 2;
+    t->left = (correlate) ? kw / 2 : kw - 1 - kw / 2;
+    t->plan = fft_plan_create(tile, plan_mode);
+
+    size_t size = (size_t)tile * tile;
+    cplx* v = (cplx*)calloc(size, sizeof(cplx));
+    t->spectrum = (cplx*)malloc(size * sizeof(cplx));
+
+    double scale = 1.0 / (double)size;
+    for(int i = 0; i < kh; i++){
+        for(int j = 0; j < kw; j++){
+            real_t k = (correlate) ? kernel[(kh - 1 - i) * kw + (kw - 1 - j)] : kernel[i * kw + j];
+            v[(size_t)i * tile + j] = k * scale;
+        }
+    }
+
+    fft_execute_2d(t->plan, t->plan, v, t->spectrum, kh, 0);
+
+    free(v);
+    return t;
+}
+
+// Function to convolve a band of rows of an image with overlap-save
+// Each tile holds the inputs of t->cols x t->band outputs plus the overlap
+// of the kernel, and the first kh - 1 rows and kw - 1 columns of its circular
+// convolution are dropped. The kernel is real, so two tiles go through one
+// complex transform, in the real and in the imaginary parts. The pairs of
+// tiles are divided among the threads, each with its own buffers
+// t = tiler
+// rows = num_rows rows of the image from first_row, the other rows count as zeros
+// first_row, num_rows = rows of the image in rows, at least the rows
+//      oy - t->up to oy - t->up + t->tile - 1 that exist in the image
+// oy = first output row
+// out_rows = number of output rows, at most t->band
+// out = out_rows rows of t->width values
+void conv_tiler_band(const conv_tiler_t* t, const real_t* rows, int first_row, int num_rows, int oy, int out_rows, real_t* out){
+    int tile = t->tile;
+    int width = t->width;
+    int y0 = oy - t->up;
+    int tiles = (width + t->cols - 1) / t->cols;
+    int pairs = (tiles + 1) / 2;
+
+    // Tile rows below the available rows are zeros
+    int live_rows = first_row + num_rows - y0;
+    if(live_rows > tile) live_rows = tile;
+    if(live_rows < 0) live_rows = 0;
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        size_t size = (size_t)tile * tile;
+        cplx* v = (cplx*)malloc(size * sizeof(cplx));
+        cplx* w = (cplx*)malloc(size * sizeof(cplx));
+
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for(int p = 0; p < pairs; p++){
+            real_t* d = (real_t*)v;
+
+            // Tile 2p in the real part and tile 2p + 1 in the imaginary part
+            for(int half = 0; half < 2; half++){
+                int x0 = (2 * p + half) * t->cols - t->left;
+
+                for(int r = 0; r < tile; r++){
+                    real_t* drow = d + 2 * (size_t)r * tile + half;
+                    int y = y0 + r;
+
+                    if(y < first_row || y >= first_row + num_rows || 2 * p + half >= tiles){
+                        for(int c = 0; c < tile; c++) drow[2 * c] = 0;
+                        continue;
+                    }
+
+                    const real_t* src = rows + (size_t)(y - first_row) * width;
+                    for(int c = 0; c < tile; c++){
+                        int x = x0 + c;
+                        drow[2 * c] = (x >= 0 && x < width) ? src[x] : 0;
+                    }
+                }
+            }
+
+            fft_execute_2d(t->plan, t->plan, v, w, live_rows, 0);
+
+            for(size_t i = 0; i < size; i++){
+                w[i] *= t->spectrum[i];
+            }
+
+            fft_execute_2d(t->plan, t->plan, w, v, t->kh - 1 + out_rows, 1);
+
+            // Drop the rows and columns wrapped around by the circular convolution
+            for(int half = 0; half < 2 && 2 * p + half < tiles; half++){
+                int ox = (2 * p + half) * t->cols;
+                int n = (ox + t->cols <= width) ? t->cols : width - ox;
+                int skip = tile - t->cols;
+
+                for(int r = 0; r < out_rows; r++){
+                    const real_t* src = d + 2 * ((size_t)(r + t->kh - 1) * tile + skip) + half;
+                    real_t* dst = out + (size_t)r * width + ox;
+                    for(int c = 0; c < n; c++){
+                        dst[c] = src[2 * c];
+                    }
+                }
+            }
+        }
+
+        free(v);
+        free(w);
+    }
+}
+
+// Function to free a tiler
+// t = tiler
+void conv_tiler_destroy(conv_tiler_t* t){
+    fft_plan_destroy(t->plan);
+    free(t->spectrum);
+    free(t);
+}
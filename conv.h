@@ -0,0 +1,41 @@
+#ifndef CONV_H_
+#define CONV_H_
+
+#include "pgm.h"
+#include "fft_plan.h"
+
+// Methods of conv2d
+#define CONV_AUTO 0
+#define CONV_DIRECT 1
+#define CONV_FFT 2
+
+int conv2d_choose(int, int, int, int);
+
+void conv2d_direct(const real_t*, int, int, const real_t*, int, int, int, real_t*);
+
+void conv2d_fft(const real_t*, int, int, const real_t*, int, int, int, int, real_t*);
+
+int conv2d(const real_t*, int, int, const real_t*, int, int, int, int, int, real_t*);
+
+// Overlap-save convolution in bands of square tiles, see conv_tiler_band
+typedef struct conv_tiler{
+    int width;          // width of the image
+    int kh;             // height of the kernel
+    int tile;           // size of the tiles, a power of 2
+    int band;           // output rows of a band of tiles
+    int cols;           // output columns of a tile
+    int up;             // input rows above the first output row of a band
+    int left;           // input columns left of the first output column of a tile
+    fft_plan_t *plan;   // plan of the tile size
+    cplx *spectrum;     // spectrum of the kernel, transposed and divided by tile * tile
+}conv_tiler_t;
+
+int conv_tile_size(int, int);
+
+conv_tiler_t* conv_tiler_create(int, const real_t*, int, int, int, int, int);
+
+void conv_tiler_band(const conv_tiler_t*, const real_t*, int, int, int, int, real_t*);
+
+void conv_tiler_destroy(conv_tiler_t*);
+
+#endif
@@ -25,4 +25,32 @@ cplx* fftshift(cplx* in, int x, int y){
 
 cplx* ifftshift(cplx* in, int x, int y){
     return _circshift(in, x, y, ((x+1)/2), ((y+1)/2));
-}
\ No newline at end of file
+}
+
+// Function to perform fftshift in place on a matrix with even dimensions
+// Swapping the opposite quadrants is the same as shifting by half in each dimension
+// in = matrix, overwritten with the shifted matrix
+// x = number of rows
+// y = number of columns
+void fftshift_inplace(cplx* in, int x, int y){
+    int hx = x / 2;
+    int hy = y / 2;
+
+    #ifdef _OPENMP
+    #pragma omp parallel for
+    #endif
+    for (int i = 0; i < hx; i++) {
+        cplx* top = in + (size_t)i * y;
+        cplx* bottom = in + (size_t)(i + hx) * y;
+
+        for (int j = 0; j < hy; j++) {
+            cplx tmp = top[j];
+            top[j] = bottom[j + hy];
+            bottom[j + hy] = tmp;
+
+            tmp = top[j + hy];
+            top[j + hy] = bottom[j];
+            bottom[j] = tmp;
+        }
+    }
+}
@@ -3,5 +3,6 @@
 
 cplx* fftshift(cplx*, int, int);
 cplx* ifftshift(cplx*, int, int);
+void fftshift_inplace(cplx*, int, int);
 
 #endif 
\ No newline at end of file
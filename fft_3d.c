@@ -0,0 +1,127 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <complex.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "pgm.h"
+#include "fft_plan.h"
+#include "filter.h"
+#include "volume.h"
+
+// Function to calculate the next power of 2
+// num = number to calculate the next power of 2
+// return = next power of 2
+int nextPowerOf2(int num) {
+    int power = 1;
+    while (power < num) {
+        power *= 2;
+    }
+    return power;
+}
+
+// Function to get the peak memory of the process
+// return = peak resident set size in KB
+long peak_rss_kb(void){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+
+int main(int argc, char** argv){
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(argc < 2){
+        printf("Uso: %s <fatia_0.pgm> <fatia_1.pgm> ... [--cutoff <fração> | --filters <spec>] [--estimate]\n", argv[0]);
+        return 1;
+    }
+
+    // Plan without measuring the kernels with --estimate
+    // Radius of the filter, as a fraction of the size, with --cutoff <fraction>
+    // or one filter with --filters <spec> (hp:<r>, lp:<r>, bp:<r1>:<r2>)
+    // The other arguments are the slices, in order of depth
+    int plan_mode = FFT_MEASURE;
+    filter_spec_t spec = {FILTER_HIGHPASS, 0.1, 0};
+    char** slices = (char**)malloc(argc * sizeof(char*));
+    int num_slices = 0;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--estimate") == 0){
+            plan_mode = FFT_ESTIMATE;
+        } else if(strcmp(argv[i], "--cutoff") == 0 && i + 1 < argc){
+            spec.type = FILTER_HIGHPASS;
+            spec.low = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--filters") == 0 && i + 1 < argc){
+            filter_spec_t *specs;
+            if(filter_parse_specs(argv[++i], &specs) != 1){
+                printf("Filtro inválido: %s (use um só filtro hp:<r>, lp:<r> ou bp:<r1>:<r2>)\n", argv[i]);
+                exit(1);
+            }
+            spec = specs[0];
+            free(specs);
+        } else {
+            slices[num_slices++] = argv[i];
+        }
+    }
+
+    pgm_t img;
+    if(num_slices == 0 || volume_read_header(slices, num_slices, &img) != 0){
+        printf("Error opening file (as fatias devem ter o mesmo tamanho)\n");
+        exit(1);
+    }
+
+    // Size of the padded slices (square, power of 2) and of the padded depth
+    int n = nextPowerOf2(img.width);
+    if(nextPowerOf2(img.height) > n){
+        n = nextPowerOf2(img.height);
+    }
+    int depth = nextPowerOf2(num_slices);
+    size_t plane = (size_t)n * n;
+
+    // The slices are read into the first planes and the rest is the zero padding
+    cplx* v = (cplx*)calloc(plane * depth, sizeof(cplx));
+    if(volume_read_slices(slices, 0, num_slices, n, v) != 0){
+        printf("Error opening file\n");
+        exit(1);
+    }
+
+    fft_plan_t* plan = fft_plan_create(n, plan_mode);
+    fft_plan_t* depth_plan = fft_plan_create(depth, plan_mode);
+
+    //################# START 3D FFT #################
+    // 2D FFT of each slice, the padding slices stay zero
+    volume_fft_slices(plan, v, num_slices, 0);
+
+    // FFT along the depth: the planes are interleaved vectors, one per element
+    fft_execute_batch(depth_plan, v, (int)plane, 0);
+    //################# END 3D FFT #################
+
+    filter_apply_3d(v, n, n, depth, 0, n, &spec);
+
+    //################# START 3D iFFT #################
+    fft_execute_batch(depth_plan, v, (int)plane, 1);
+
+    // Only the slices of the stack are written
+    volume_fft_slices(plan, v, num_slices, 1);
+    //################# END 3D iFFT #################
+
+    volume_write_slices(v, 0, num_slices, n, &img, 1.0 / ((double)plane * depth));
+
+    free(v);
+    free(slices);
+    fft_plan_destroy(plan);
+    fft_plan_destroy(depth_plan);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("Volume: %dx%dx%d (%dx%dx%d)\n", img.width, img.height, num_slices, n, n, depth);
+    printf("Time: %.10lf\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    printf("Peak RSS: %ld KB\n", peak_rss_kb());
+    return 0;
+
+}
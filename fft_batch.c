@@ -0,0 +1,236 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <complex.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "pgm.h"
+#include "fft_plan.h"
+#include "spectrum.h"
+#include "filter.h"
+
+// Images of a batch at most, by default
+#define BATCH_MAX 64
+
+// An image of the command line
+typedef struct batch_image{
+    char *path;
+    int index;      // position among the images, the output is results/ifft_<index>.pgm
+    int n;          // size of the padded image
+    pgm_t header;
+}batch_image_t;
+
+// Function to calculate the next power of 2
+// num = number to calculate the next power of 2
+// return = next power of 2
+int nextPowerOf2(int num) {
+    int power = 1;
+    while (power < num) {
+        power *= 2;
+    }
+    return power;
+}
+
+// Function to get the peak memory of the process
+// return = peak resident set size in KB
+long peak_rss_kb(void){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Function to order the images by padded size, then by position
+int by_size(const void *a, const void *b){
+    const batch_image_t *x = (const batch_image_t*)a;
+    const batch_image_t *y = (const batch_image_t*)b;
+    if(x->n != y->n) return (x->n < y->n) ? -1 : 1;
+    return (x->index < y->index) ? -1 : (x->index > y->index);
+}
+
+// Function to read the header of an image and its padded size
+// image = image, path and index already set
+void read_header(batch_image_t *image){
+    FILE *fp = fopen(image->path, "rb");
+    if(fp == NULL || pgm_read_header(fp, &image->header) != 0){
+        printf("Error opening file\n");
+        exit(1);
+    }
+    fclose(fp);
+
+    image->n = nextPowerOf2(image->header.width);
+    if(nextPowerOf2(image->header.height) > image->n){
+        image->n = nextPowerOf2(image->header.height);
+    }
+}
+
+// Function to filter a batch of images of the same padded size
+// The images are interleaved in one buffer (batch x n x n) and every
+// butterfly of the 2D transforms runs over the whole batch at once
+// images = images of the batch
+// count = number of images
+// n = padded size of the images
+// plan = batch plan of size n
+// mask = mask of the filter for size n
+void filter_batch(const batch_image_t *images, int count, int n, const fft_plan_t *plan, const filter_mask_t *mask){
+    cplx *v = (cplx*)calloc((size_t)n * n * count, sizeof(cplx));
+
+    // Read each image into its lane, the padding stays zero
+    #pragma omp parallel
+    {
+        real_t *row = (real_t*)malloc(n * sizeof(real_t));
+
+        #pragma omp for schedule(dynamic)
+        for(int b = 0; b < count; b++){
+            const pgm_t *img = &images[b].header;
+            FILE *fp = fopen(images[b].path, "rb");
+            pgm_t header;
+            if(fp == NULL || pgm_read_header(fp, &header) != 0){
+                printf("Error opening file\n");
+                exit(1);
+            }
+
+            for(int y = 0; y < img->height; y++){
+                pgm_read_rows(fp, img, row, 1);
+                cplx *dst = v + (size_t)y * n * count + b;
+                for(int x = 0; x < img->width; x++){
+                    dst[(size_t)x * count] = row[x];
+                }
+            }
+            fclose(fp);
+        }
+
+        free(row);
+    }
+
+    fft_execute_2d_batch(plan, plan, v, count, 0);
+    filter_mask_apply_batch(mask, v, count);
+    fft_execute_2d_batch(plan, plan, v, count, 1);
+
+    // Take each image out of its lane, normalize, crop and write it
+    #pragma omp parallel
+    {
+        cplx *line = (cplx*)malloc(n * sizeof(cplx));
+        unsigned char *pixels = NULL;
+        char name[64];
+
+        #pragma omp for schedule(dynamic)
+        for(int b = 0; b < count; b++){
+            const pgm_t *img = &images[b].header;
+
+            // 16-bit images are written with 8 bits
+            double scale = 1.0 / ((double)n * n);
+            int max = img->max;
+            if(max > 255){
+                scale *= 255.0 / max;
+                max = 255;
+            }
+
+            pixels = (unsigned char*)realloc(pixels, (size_t)img->width * img->height);
+            for(int y = 0; y < img->height; y++){
+                const cplx *src = v + (size_t)y * n * count + b;
+                for(int x = 0; x < img->width; x++){
+                    line[x] = src[(size_t)x * count];
+                }
+                spectrum_abs_u8(line, img->width, scale, pixels + (size_t)y * img->width);
+            }
+
+            sprintf(name, "results/ifft_%d.pgm", images[b].index);
+            pgm_write_u8(name, pixels, img->width, img->height, max);
+        }
+
+        free(line);
+        free(pixels);
+    }
+
+    free(v);
+}
+
+
+int main(int argc, char** argv){
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(argc < 2){
+        printf("Uso: %s <imagem.pgm> ... [--cutoff <fração> | --filters <spec>] [--batch <k>]\n", argv[0]);
+        return 1;
+    }
+
+    // Radius of the filter, as a fraction of the size, with --cutoff <fraction>
+    // or one filter with --filters <spec> (hp:<r>, lp:<r>, bp:<r1>:<r2>)
+    // At most <k> images are transformed together with --batch <k>
+    filter_spec_t spec = {FILTER_HIGHPASS, 0.1, 0};
+    int batch = BATCH_MAX;
+
+    batch_image_t *images = (batch_image_t*)malloc(argc * sizeof(batch_image_t));
+    int num_images = 0;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--cutoff") == 0 && i + 1 < argc){
+            spec.type = FILTER_HIGHPASS;
+            spec.low = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--filters") == 0 && i + 1 < argc){
+            filter_spec_t *specs;
+            if(filter_parse_specs(argv[++i], &specs) != 1){
+                printf("Filtro inválido: %s (use um só filtro hp:<r>, lp:<r> ou bp:<r1>:<r2>)\n", argv[i]);
+                exit(1);
+            }
+            spec = specs[0];
+            free(specs);
+        } else if(strcmp(argv[i], "--batch") == 0 && i + 1 < argc){
+            batch = atoi(argv[++i]);
+            if(batch < 1){
+                printf("Lote inválido: %s\n", argv[i]);
+                exit(1);
+            }
+        } else {
+            images[num_images].path = argv[i];
+            images[num_images].index = num_images;
+            num_images++;
+        }
+    }
+
+    #pragma omp parallel for
+    for(int k = 0; k < num_images; k++){
+        read_header(&images[k]);
+    }
+
+    // Images of the same padded size go in the same batches
+    qsort(images, num_images, sizeof(batch_image_t), by_size);
+
+    int batches = 0;
+    for(int first = 0; first < num_images; ){
+        int n = images[first].n;
+        int last = first;
+        while(last < num_images && images[last].n == n){
+            last++;
+        }
+
+        // One plan and one mask for every batch of this size
+        fft_plan_t *plan = fft_plan_create_batch(n);
+        filter_mask_t *mask = filter_mask_create(n, n, &spec);
+
+        for(int b = first; b < last; b += batch){
+            int count = (last - b < batch) ? last - b : batch;
+            filter_batch(images + b, count, n, plan, mask);
+            batches++;
+        }
+
+        filter_mask_destroy(mask);
+        fft_plan_destroy(plan);
+        first = last;
+    }
+
+    free(images);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("Images: %d (%d batches)\n", num_images, batches);
+    printf("Time: %.10lf\n", seconds);
+    printf("Peak RSS: %ld KB\n", peak_rss_kb());
+    return 0;
+
+}
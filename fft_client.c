@@ -0,0 +1,186 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "pgm.h"
+#include "filter.h"
+#include "service.h"
+
+// Function to connect to the server
+// path = path of the socket
+// return = connected socket
+int connect_to(char* path){
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    if(sock < 0 || connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0){
+        printf("Error connecting to %s\n", path);
+        exit(1);
+    }
+    return sock;
+}
+
+// Function to ask the server for its statistics and print them
+// path = path of the socket
+void print_stats(char* path){
+    int sock = connect_to(path);
+
+    service_request_t req;
+    memset(&req, 0, sizeof(req));
+    req.magic = SERVICE_MAGIC;
+    req.kind = SERVICE_STATS;
+
+    service_stats_t stats;
+    int fd;
+    if(service_send(sock, &req, sizeof(req), -1) != 0 || service_recv(sock, &stats, sizeof(stats), &fd) != 0){
+        printf("Error talking to the server\n");
+        exit(1);
+    }
+    close(sock);
+
+    printf("Threads: %d (%d busy)\n", stats.threads, stats.busy);
+    printf("Queue depth: %d\n", stats.queue_depth);
+    printf("Jobs: %llu (%llu errors)\n", (unsigned long long)stats.jobs, (unsigned long long)stats.errors);
+    printf("Uptime: %.1lf s\n", stats.uptime_s);
+    printf("Latency: %.3lf ms (p50), %.3lf ms (p90), %.3lf ms (p99), %.3lf ms (max)\n",
+           stats.p50_ms, stats.p90_ms, stats.p99_ms, stats.max_ms);
+}
+
+
+int main(int argc, char** argv){
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(argc < 3){
+        printf("Uso: %s <socket> <imagem.pgm> [--send fd|path|inline] [--cutoff <fração> | --filters <spec>]\n"
+               "       [--spectrum] [--filtered-spectrum] [--no-image]\n"
+               "       %s <socket> --stats\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    if(strcmp(argv[2], "--stats") == 0){
+        print_stats(argv[1]);
+        return 0;
+    }
+
+    // How the image gets to the server with --send: the open file (fd, default),
+    // its path or its bytes through the socket (inline)
+    // Filter with --cutoff <fraction> (high-pass) or --filters <spec> (one spec)
+    // Also get fft.pgm with --spectrum and filtered_fft.pgm with --filtered-spectrum
+    // Skip ifft.pgm with --no-image
+    service_request_t req;
+    memset(&req, 0, sizeof(req));
+    req.magic = SERVICE_MAGIC;
+    req.kind = SERVICE_JOB;
+    req.source = SERVICE_SRC_FD;
+    req.outputs = SERVICE_OUT_IMAGE;
+    req.filter_type = FILTER_HIGHPASS;
+    req.filter_low = 0.1;
+
+    for(int i = 3; i < argc; i++){
+        if(strcmp(argv[i], "--send") == 0 && i + 1 < argc){
+            i++;
+            req.source = (strcmp(argv[i], "path") == 0) ? SERVICE_SRC_PATH : (strcmp(argv[i], "inline") == 0) ? SERVICE_SRC_INLINE : SERVICE_SRC_FD;
+        } else if(strcmp(argv[i], "--cutoff") == 0 && i + 1 < argc){
+            req.filter_type = FILTER_HIGHPASS;
+            req.filter_low = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--filters") == 0 && i + 1 < argc){
+            filter_spec_t *specs;
+            if(filter_parse_specs(argv[++i], &specs) != 1){
+                printf("Filtro inválido: %s (use um só filtro hp:<r>, lp:<r> ou bp:<r1>:<r2>)\n", argv[i]);
+                exit(1);
+            }
+            req.filter_type = specs[0].type;
+            req.filter_low = specs[0].low;
+            req.filter_high = specs[0].high;
+            free(specs);
+        } else if(strcmp(argv[i], "--spectrum") == 0){
+            req.outputs |= SERVICE_OUT_SPECTRUM;
+        } else if(strcmp(argv[i], "--filtered-spectrum") == 0){
+            req.outputs |= SERVICE_OUT_FILTERED;
+        } else if(strcmp(argv[i], "--no-image") == 0){
+            req.outputs &= ~SERVICE_OUT_IMAGE;
+        }
+    }
+
+    int file = open(argv[2], O_RDONLY);
+    struct stat st;
+    if(file < 0 || fstat(file, &st) != 0){
+        printf("Error opening file\n");
+        exit(1);
+    }
+
+    int sock = connect_to(argv[1]);
+    int sent;
+
+    if(req.source == SERVICE_SRC_PATH){
+        // The server may run in another directory
+        char *path = realpath(argv[2], NULL);
+        req.length = strlen(path);
+        sent = service_send(sock, &req, sizeof(req), -1) == 0 && service_send(sock, path, req.length, -1) == 0;
+        free(path);
+    } else if(req.source == SERVICE_SRC_INLINE){
+        req.length = st.st_size;
+        char *bytes = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        sent = bytes != MAP_FAILED && service_send(sock, &req, sizeof(req), -1) == 0 && service_send(sock, bytes, st.st_size, -1) == 0;
+        if(bytes != MAP_FAILED) munmap(bytes, st.st_size);
+    } else {
+        sent = service_send(sock, &req, sizeof(req), file) == 0;
+    }
+
+    service_reply_t reply;
+    int mfd;
+    if(!sent || service_recv(sock, &reply, sizeof(reply), &mfd) != 0){
+        printf("Error talking to the server\n");
+        exit(1);
+    }
+    close(sock);
+    close(file);
+
+    if(reply.status != SERVICE_OK || mfd < 0){
+        printf("Job failed: %s\n", (reply.status == SERVICE_ERR_IMAGE) ? "invalid image" : "invalid request");
+        exit(1);
+    }
+
+    // The outputs are read straight from the memfd of the server
+    size_t total = 0;
+    for(int k = 0; k < SERVICE_OUTPUTS; k++){
+        total += reply.size[k];
+    }
+    unsigned char *out = (unsigned char*)mmap(NULL, total, PROT_READ, MAP_SHARED, mfd, 0);
+    if(out == MAP_FAILED){
+        printf("Error mapping the outputs\n");
+        exit(1);
+    }
+
+    if(reply.size[0] > 0){
+        pgm_write_u8("results/ifft.pgm", out + reply.offset[0], reply.width, reply.height, reply.max);
+    }
+    if(reply.size[1] > 0){
+        pgm_write_u8("results/fft.pgm", out + reply.offset[1], reply.n, reply.n, reply.max);
+    }
+    if(reply.size[2] > 0){
+        pgm_write_u8("results/filtered_fft.pgm", out + reply.offset[2], reply.n, reply.n, reply.max);
+    }
+
+    munmap(out, total);
+    close(mfd);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("Queue: %.3lf ms, Run: %.3lf ms\n", reply.queue_ms, reply.run_ms);
+    printf("Time: %.10lf\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    return 0;
+
+}
@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <complex.h>
+#include <math.h>
+#include <time.h>
+#include <ctype.h>
+#include <sys/resource.h>
+#include "pgm.h"
+#include "fft_plan.h"
+#include "conv.h"
+
+// Function to read an image as real values
+// filename = path of the image
+// img = header of the image
+// return = img->height rows of img->width values
+real_t* read_real(char* filename, pgm_t* img){
+    FILE* fp = fopen(filename, "rb");
+    if(fp == NULL || pgm_read_header(fp, img) != 0){
+        printf("Error opening file\n");
+        exit(1);
+    }
+
+    size_t size = (size_t)img->width * img->height;
+    cplx* data = (cplx*)malloc(size * sizeof(cplx));
+    pgm_read_data(fp, img, data, img->width);
+    fclose(fp);
+
+    real_t* v = (real_t*)malloc(size * sizeof(real_t));
+    for(size_t i = 0; i < size; i++){
+        v[i] = creal(data[i]);
+    }
+
+    free(data);
+    return v;
+}
+
+// Function to get the peak memory of the process
+// return = peak resident set size in KB
+long peak_rss_kb(void){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Function to get the range of the result
+// v = values
+// size = number of values
+// lo, hi = updated with the minimum and the maximum of the values
+void range_of(const real_t* v, size_t size, double* lo, double* hi){
+    for(size_t i = 0; i < size; i++){
+        if(v[i] < *lo) *lo = v[i];
+        if(v[i] > *hi) *hi = v[i];
+    }
+}
+
+// Function to convert the result to 8-bit pixels
+// v = values
+// size = number of values
+// max = maximum value of the output
+// lo, hi = range of the values mapped to [0, max], the rest is clamped
+// pixels = output
+void to_pixels(const real_t* v, size_t size, int max, double lo, double hi, unsigned char* pixels){
+    double scale = (hi > lo) ? max / (hi - lo) : 0;
+
+    for(size_t i = 0; i < size; i++){
+        double level = nearbyint((v[i] - lo) * scale);
+        pixels[i] = (level < 0) ? 0 : (level > max) ? max : (unsigned char)level;
+    }
+}
+
+// Function to convolve an image in bands of tiles, reading and writing it
+// band by band, so the memory does not depend on the height of the image
+// With rescale the bands are computed twice: once for the range, once to write
+// input, output = paths of the images
+// kernel, kw, kh, correlate = see conv2d_direct
+// tile = size of the tiles, 0 to choose it
+// plan_mode = FFT_MEASURE or FFT_ESTIMATE
+// rescale = map the range of the result to the range of the output
+// return = size of the tiles
+int conv_tiled(char* input, char* output, const real_t* kernel, int kw, int kh, int correlate, int tile, int plan_mode, int rescale){
+    FILE* fp = fopen(input, "rb");
+    pgm_t img;
+    if(fp == NULL || pgm_read_header(fp, &img) != 0){
+        printf("Error opening file\n");
+        exit(1);
+    }
+    long data_start = ftell(fp);
+
+    conv_tiler_t* t = conv_tiler_create(img.width, kernel, kw, kh, correlate, tile, plan_mode);
+    if(t == NULL){
+        printf("Tile inválido: %d (potência de 2, não menor que o kernel)\n", tile);
+        exit(1);
+    }
+    tile = t->tile;
+
+    int width = img.width;
+    int max = (img.max < 255) ? img.max : 255;
+
+    // Rows of the image from first_row, at most one tile
+    real_t* rows = (real_t*)malloc((size_t)t->tile * width * sizeof(real_t));
+    real_t* band = (real_t*)malloc((size_t)t->band * width * sizeof(real_t));
+    unsigned char* pixels = (unsigned char*)malloc((size_t)t->band * width);
+
+    double lo = 0, hi = max;
+    if(rescale){
+        lo = INFINITY;
+        hi = -INFINITY;
+    }
+
+    for(int pass = (rescale) ? 0 : 1; pass < 2; pass++){
+        FILE* out = (pass == 1) ? pgm_create_u8(output, width, img.height, max) : NULL;
+
+        fseek(fp, data_start, SEEK_SET);
+        int first_row = 0;
+        int num_rows = 0;
+
+        for(int oy = 0; oy < img.height; oy += t->band){
+            int out_rows = (oy + t->band <= img.height) ? t->band : img.height - oy;
+
+            // Drop the rows above the band and read the rows it still needs
+            int y0 = (oy - t->up > 0) ? oy - t->up : 0;
+            int y1 = (oy - t->up + t->tile < img.height) ? oy - t->up + t->tile : img.height;
+
+            int drop = y0 - first_row;
+            if(drop > 0){
+                num_rows -= drop;
+                memmove(rows, rows + (size_t)drop * width, (size_t)num_rows * width * sizeof(real_t));
+                first_row = y0;
+            }
+            pgm_read_rows(fp, &img, rows + (size_t)num_rows * width, y1 - first_row - num_rows);
+            num_rows = y1 - first_row;
+
+            conv_tiler_band(t, rows, first_row, num_rows, oy, out_rows, band);
+
+            size_t size = (size_t)out_rows * width;
+            if(pass == 0){
+                range_of(band, size, &lo, &hi);
+            } else {
+                to_pixels(band, size, max, lo, hi, pixels);
+                pgm_write_u8_rows(out, pixels, width, out_rows);
+            }
+        }
+
+        if(out != NULL) fclose(out);
+    }
+
+    free(rows);
+    free(band);
+    free(pixels);
+    fclose(fp);
+    conv_tiler_destroy(t);
+
+    return tile;
+}
+
+int main(int argc, char** argv){
+
+    int start = clock();
+
+    if(argc < 4){
+        printf("Uso: %s <imagem.pgm> <kernel.pgm> <saida.pgm> [--correlate] [--method auto|direct|fft]\n"
+               "       [--normalize] [--kernel-offset <v>] [--rescale] [--estimate] [--tile [<n>]]\n", argv[0]);
+        return 1;
+    }
+
+    // Correlation instead of convolution with --correlate
+    // Force a method with --method direct or --method fft
+    // Divide the kernel by the sum of its elements with --normalize
+    // Subtract a value from the kernel (signed kernels in a pgm) with --kernel-offset <v>
+    // Map the range of the result to the range of the output with --rescale
+    // Plan without measuring the kernels with --estimate
+    // Filter in bands of tiles of n x n (chosen from the kernel without n) with --tile [<n>]
+    int correlate = 0;
+    int method = CONV_AUTO;
+    int normalize = 0;
+    double kernel_offset = 0;
+    int rescale = 0;
+    int plan_mode = FFT_MEASURE;
+    int tiled = 0;
+    int tile = 0;
+
+    for(int i = 4; i < argc; i++){
+        if(strcmp(argv[i], "--correlate") == 0){
+            correlate = 1;
+        } else if(strcmp(argv[i], "--method") == 0 && i + 1 < argc){
+            i++;
+            method = (strcmp(argv[i], "direct") == 0) ? CONV_DIRECT : (strcmp(argv[i], "fft") == 0) ? CONV_FFT : CONV_AUTO;
+        } else if(strcmp(argv[i], "--normalize") == 0){
+            normalize = 1;
+        } else if(strcmp(argv[i], "--kernel-offset") == 0 && i + 1 < argc){
+            kernel_offset = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--rescale") == 0){
+            rescale = 1;
+        } else if(strcmp(argv[i], "--estimate") == 0){
+            plan_mode = FFT_ESTIMATE;
+        } else if(strcmp(argv[i], "--tile") == 0){
+            tiled = 1;
+            if(i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])){
+                tile = atoi(argv[++i]);
+            }
+        }
+    }
+
+    pgm_t ker;
+    real_t* kernel = read_real(argv[2], &ker);
+
+    size_t ksize = (size_t)ker.width * ker.height;
+    double sum = 0;
+    for(size_t i = 0; i < ksize; i++){
+        kernel[i] -= kernel_offset;
+        sum += kernel[i];
+    }
+    if(normalize && sum != 0){
+        for(size_t i = 0; i < ksize; i++){
+            kernel[i] /= sum;
+        }
+    }
+
+    if(tiled){
+        tile = conv_tiled(argv[1], argv[3], kernel, ker.width, ker.height, correlate, tile, plan_mode, rescale);
+        free(kernel);
+
+        int end = clock();
+
+        printf("Method: tiled %dx%d\n", tile, tile);
+        printf("Time: %.10lf\n", (double)(end - start) / CLOCKS_PER_SEC);
+        printf("Peak RSS: %ld KB\n", peak_rss_kb());
+        return 0;
+    }
+
+    pgm_t img;
+    real_t* image = read_real(argv[1], &img);
+
+    real_t* out = (real_t*)malloc((size_t)img.width * img.height * sizeof(real_t));
+    method = conv2d(image, img.width, img.height, kernel, ker.width, ker.height, correlate, method, plan_mode, out);
+
+    // Write the result
+    size_t size = (size_t)img.width * img.height;
+    int max = (img.max < 255) ? img.max : 255;
+    double lo = 0, hi = max;
+    if(rescale){
+        lo = hi = out[0];
+        range_of(out, size, &lo, &hi);
+    }
+
+    unsigned char* pixels = (unsigned char*)malloc(size);
+    to_pixels(out, size, max, lo, hi, pixels);
+    pgm_write_u8(argv[3], pixels, img.width, img.height, max);
+
+    free(image);
+    free(kernel);
+    free(out);
+    free(pixels);
+
+    int end = clock();
+
+    printf("Method: %s\n", (method == CONV_DIRECT) ? "direct" : "fft");
+    printf("Time: %.10lf\n", (double)(end - start) / CLOCKS_PER_SEC);
+    printf("Peak RSS: %ld KB\n", peak_rss_kb());
+    return 0;
+
+}
@@ -1,46 +1,21 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <complex.h>
 #include <mpi.h>
 #include <math.h>
+#ifdef _OPENMP
+#include <omp.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
 #include "pgm.h"
-#include "cshift.h"
-
-#define PI 3.14159265358979323846
-
-typedef double complex cplx;
-
-// Function to convert a matrix in form of a vector
-// mat = matrix
-// width = number of columns
-// height = number of rows
-// return = vector
-cplx* mat2vet(cplx** mat, int width, int height){
-	cplx *v = (cplx*)malloc(height * width * sizeof(cplx));
-	for(int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            v[i * width + j] = mat[i][j];
-        }
-    }
-	return v;
-}
-
-// Function to convert a vector in form of a matrix
-// v = vector
-// width = number of columns
-// height = number of rows
-// return = matrix
-cplx** vet2mat(cplx* v, int width, int height){
-	cplx **mat = (cplx**)malloc(height * sizeof(cplx*));
-	for(int i = 0; i < height; i++){
-		mat[i] = (cplx*)malloc(width * sizeof(cplx));
-		for (int j = 0; j < width; j++){
-			mat[i][j] = v[i * width + j];
-		}
-	}
-	return mat;
-}
+#include "fft_plan.h"
+#include "pgm_mpi.h"
+#include "filter.h"
+#include "spectrum.h"
+#include "volume.h"
 
 // Function to calculate the next power of 2
 // num = number to calculate the next power of 2
@@ -61,287 +36,865 @@ int is_power_of_two(int x)
     return (x != 0) && ((x & (x - 1)) == 0);
 }
 
-// Function to perform zero padding on an image
-// image = image to pad
-// return = padded image
-pgm_t zeroPadding(const pgm_t image) {
+// Function to transpose a stack of square matrices distributed by rows among the processes
+// Each process sends to every other process the block of its rows that falls
+// in the columns owned by the destination, already transposed. The blocks of
+// all the matrices of the stack go in the same message
+// v = local rows of the matrices (nb slabs of row_counts[rank] * n elements),
+//     overwritten with the local rows of the transposed matrices
+// send, recv = work vectors with the same size as v
+// n = number of columns (and rows) of each matrix
+// nb = number of matrices in the stack
+// row_counts = number of rows of each process
+// row_displs = first row of each process
+// comm = communicator of the processes
+void transpose_mpi(cplx* v, cplx* send, cplx* recv, int n, int nb, const int* row_counts, const int* row_displs, MPI_Comm comm){
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
 
-    pgm_t paddedImage;
-    int newWidth = nextPowerOf2(image.width);
-    int newHeight = nextPowerOf2(image.height);
+    int my_rows = row_counts[rank];
+    size_t slab = (size_t)my_rows * n;
 
-    // If the image is not square, pad the image to make it square
-    if (newWidth != newHeight) {
-        newWidth = newHeight = (newWidth > newHeight) ? newWidth : newHeight;
-    }
+    // The messages are counted in columns of the local rows (my_rows elements),
+    // so the counts stay below nb * n even when the elements do not fit in an int
+    MPI_Datatype column_type;
+    MPI_Type_contiguous((my_rows > 0) ? my_rows : 1, MPI_CPLX, &column_type);
+    MPI_Type_commit(&column_type);
+
+    int* counts = (int*)malloc(size * sizeof(int));
+    int* displs = (int*)malloc(size * sizeof(int));
 
-    // Allocate memory for the padded image
-    paddedImage.data = (cplx**)malloc(newHeight * sizeof(cplx*));
-    for (int i = 0; i < newHeight; i++) {
-        paddedImage.data[i] = (cplx*)calloc(newWidth, sizeof(cplx));
+    int displacement = 0;
+    for(int p = 0; p < size; p++){
+        counts[p] = (my_rows > 0) ? nb * row_counts[p] : 0;
+        displs[p] = displacement;
+        displacement += counts[p];
     }
 
-    // Copy the image into the padded image
-    for (int i = 0; i < image.height; i++) {
-        for (int j = 0; j < image.width; j++) {
-            paddedImage.data[i][j] = image.data[i][j];
+    // Pack the block of each destination transposed
+    for(int p = 0; p < size; p++){
+        cplx* block = send + (size_t)displs[p] * my_rows;
+#ifdef _OPENMP
+        #pragma omp parallel for collapse(2)
+#endif
+        for(int b = 0; b < nb; b++){
+            for(int c = 0; c < row_counts[p]; c++){
+                for(int r = 0; r < my_rows; r++){
+                    block[((size_t)b * row_counts[p] + c) * my_rows + r] = v[b * slab + (size_t)r * n + row_displs[p] + c];
+                }
+            }
         }
     }
 
-    // Copy the info of the image into the padded image
-    paddedImage.width = newWidth;
-    paddedImage.height = newHeight;
-    paddedImage.max = image.max;
-    strcpy(paddedImage.type, image.type);
+    // The exchange is symmetric: the block received from p has nb * row_counts[p] columns
+    MPI_Alltoallv(send, counts, displs, column_type, recv, counts, displs, column_type, comm);
+
+    // Place the rows of the source process p in its columns
+#ifdef _OPENMP
+    #pragma omp parallel for collapse(2)
+#endif
+    for(int b = 0; b < nb; b++){
+        for(int c = 0; c < my_rows; c++){
+            for(int p = 0; p < size; p++){
+                cplx* block = recv + (size_t)displs[p] * my_rows + ((size_t)b * my_rows + c) * row_counts[p];
+                for(int r = 0; r < row_counts[p]; r++){
+                    v[b * slab + (size_t)c * n + row_displs[p] + r] = block[r];
+                }
+            }
+        }
+    }
 
-    return paddedImage;
+    MPI_Type_free(&column_type);
+    free(counts);
+    free(displs);
 }
 
-// Function to perform Cooley-Tukey FFT
-// x = input vector
-// N = size of the input vector
-// Forwards if inverse = 0, backwards if inverse = 1
-void cooley_tukey_fft(cplx x[], int N, int inverse) {
-    // Bit-reversal permutation
-    int i, j, k;
-    for (i = 1, j = N / 2; i < N - 1; i++) {
-        if (i < j) {
-            cplx temp = x[i];
-            x[i] = x[j];
-            x[j] = temp;
+// Work done on the rows of a chunk before they are sent in a transpose
+typedef struct chunk_work{
+    int n;          // number of columns (and rows) of the matrix
+    int first_row;  // global index of the first local row
+    int forward;    // perform the forward FFT of the rows
+    double cutoff;  // radius of the high-pass filter, negative to skip it
+    int inverse;    // perform the inverse FFT of the rows after the filter
+    const fft_plan_t* plan; // plan of the 1D transforms
+    int live_rows;  // rows from this global row on are zero padding and are skipped
+} chunk_work_t;
+
+// Function to perform the work of a chunk of local rows
+// rows = first row of the chunk
+// first = local index of the first row of the chunk
+// num_rows = number of rows in the chunk
+// arg = chunk_work_t with the work to do
+void chunk_compute(cplx* rows, int first, int num_rows, void* arg){
+    chunk_work_t* work = (chunk_work_t*)arg;
+
+    // Each row goes through all the steps while it is in cache
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i = 0; i < num_rows; i++){
+        cplx* row = rows + (size_t)i * work->n;
+
+        if(work->first_row + first + i >= work->live_rows){
+            continue;
         }
-        k = N / 2;
-        while (k <= j) {
-            j -= k;
-            k /= 2;
+
+        if(work->forward){
+            fft_execute(work->plan, row, 0);
+        }
+
+        if(work->cutoff >= 0){
+            highpass_filter(row, work->n, work->n, work->first_row + first + i, 1, work->cutoff);
+        }
+
+        if(work->inverse){
+            fft_execute(work->plan, row, 1);
         }
-        j += k;
     }
+}
 
-    // Iterative FFT or IFFT
-    double sign = (inverse) ? 1.0 : -1.0; // Sign for IFFT
-    for (int s = 1; s <= log2(N); s++) {
-        int m = 1 << s; // Subproblem size
-        cplx omega_m = cexp(sign * I * 2.0 * PI / m);
+// Function to compute and transpose a distributed stack of square matrices in chunks of rows
+// The exchange of a chunk (MPI_Ialltoallv) runs while the next chunk is computed,
+// and the received chunks are placed as soon as they arrive. The column FFTs
+// need whole columns, so they can only start after the last chunk
+// v = local rows of the matrices, overwritten with the local rows of the transposed matrices
+// send, recv = work vectors with the same size as v
+// n = number of columns (and rows) of each matrix
+// nb = number of matrices in the stack
+// row_counts = number of rows of each process
+// row_displs = first row of each process
+// nchunks = number of chunks, the same on every process
+// compute = work done on the rows of each matrix in a chunk before it is sent
+// arg = argument of compute
+// comm = communicator of the processes
+void transpose_mpi_overlap(cplx* v, cplx* send, cplx* recv, int n, int nb, const int* row_counts, const int* row_displs, int nchunks,
+                           void (*compute)(cplx*, int, int, void*), void* arg, MPI_Comm comm){
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    int my_rows = row_counts[rank];
+    size_t slab = (size_t)my_rows * n;
+
+    int* sendcounts = (int*)malloc(nchunks * size * sizeof(int));
+    int* sdispls = (int*)malloc(nchunks * size * sizeof(int));
+    int* recvcounts = (int*)malloc(nchunks * size * sizeof(int));
+    int* rdispls = (int*)malloc(nchunks * size * sizeof(int));
+    int* done = (int*)calloc(nchunks, sizeof(int));
+    MPI_Request* requests = (MPI_Request*)malloc(nchunks * sizeof(MPI_Request));
+
+    // The messages are counted in columns: a chunk is sent in columns of its
+    // my_chunk rows and received in columns of the my_rows local rows, so the
+    // counts stay below nb * n even when the elements do not fit in an int.
+    // The send buffer of chunk k starts at its own rows, so its displacements
+    // are in its own columns
+    MPI_Datatype* send_types = (MPI_Datatype*)malloc(nchunks * sizeof(MPI_Datatype));
+    MPI_Datatype recv_type;
+    MPI_Type_contiguous((my_rows > 0) ? my_rows : 1, MPI_CPLX, &recv_type);
+    MPI_Type_commit(&recv_type);
+
+    // The chunks of a process split its rows in nchunks nearly equal parts,
+    // so chunk k of process p has rows [k * rows / nchunks, (k + 1) * rows / nchunks)
+    // of every matrix
+    int displacement = 0;
+    for(int k = 0; k < nchunks; k++){
+        int my_chunk = (k + 1) * my_rows / nchunks - k * my_rows / nchunks;
+        int sdisp = 0;
+
+        MPI_Type_contiguous((my_chunk > 0) ? my_chunk : 1, MPI_CPLX, &send_types[k]);
+        MPI_Type_commit(&send_types[k]);
+
+        for(int p = 0; p < size; p++){
+            int p_chunk = (k + 1) * row_counts[p] / nchunks - k * row_counts[p] / nchunks;
+
+            sendcounts[k * size + p] = (my_chunk > 0) ? nb * row_counts[p] : 0;
+            sdispls[k * size + p] = sdisp;
+            sdisp += sendcounts[k * size + p];
+
+            recvcounts[k * size + p] = (my_rows > 0) ? nb * p_chunk : 0;
+            rdispls[k * size + p] = displacement;
+            displacement += recvcounts[k * size + p];
+        }
+    }
+
+    for(int k = 0; k < nchunks; k++){
+        int first = k * my_rows / nchunks;
+        int my_chunk = (k + 1) * my_rows / nchunks - first;
+        cplx* chunk_send = send + (size_t)nb * first * n;
+
+        for(int b = 0; b < nb; b++){
+            compute(v + b * slab + (size_t)first * n, first, my_chunk, arg);
+        }
+
+        // Pack the block of each destination transposed
+        for(int p = 0; p < size; p++){
+            cplx* block = chunk_send + (size_t)sdispls[k * size + p] * my_chunk;
+#ifdef _OPENMP
+            #pragma omp parallel for collapse(2)
+#endif
+            for(int b = 0; b < nb; b++){
+                for(int c = 0; c < row_counts[p]; c++){
+                    for(int r = 0; r < my_chunk; r++){
+                        block[((size_t)b * row_counts[p] + c) * my_chunk + r] = v[b * slab + (size_t)(first + r) * n + row_displs[p] + c];
+                    }
+                }
+            }
+        }
+
+        MPI_Ialltoallv(chunk_send, sendcounts + k * size, sdispls + k * size, send_types[k],
+                       recv, recvcounts + k * size, rdispls + k * size, recv_type, comm, &requests[k]);
+
+        // Let the previous exchanges progress
+        for(int j = 0; j < k; j++){
+            if(!done[j]){
+                MPI_Test(&requests[j], &done[j], MPI_STATUS_IGNORE);
+            }
+        }
+    }
 
-        for (int k = 0; k < N; k += m) {
-            cplx omega = 1.0;
+    // All chunks were packed, so v can receive the chunks in any order
+    for(int completed = 0; completed < nchunks; completed++){
+        // Chunks that finished while packing have a null request
+        int k = 0;
+        while(k < nchunks && done[k] != 1) k++;
 
-            for (int j = 0; j < m / 2; j++) {
-                cplx t = omega * x[k + j + m / 2];
-                cplx u = x[k + j];
-                x[k + j] = u + t;
-                x[k + j + m / 2] = u - t;
-                omega *= omega_m;
+        if(k == nchunks){
+            MPI_Waitany(nchunks, requests, &k, MPI_STATUS_IGNORE);
+        }
+        done[k] = 2;
+
+#ifdef _OPENMP
+        #pragma omp parallel for collapse(2)
+#endif
+        for(int b = 0; b < nb; b++){
+            for(int c = 0; c < my_rows; c++){
+                for(int p = 0; p < size; p++){
+                    int p_first = k * row_counts[p] / nchunks;
+                    int p_chunk = (k + 1) * row_counts[p] / nchunks - p_first;
+                    cplx* block = recv + (size_t)rdispls[k * size + p] * my_rows + ((size_t)b * my_rows + c) * p_chunk;
+
+                    for(int r = 0; r < p_chunk; r++){
+                        v[b * slab + (size_t)c * n + row_displs[p] + p_first + r] = block[r];
+                    }
+                }
             }
         }
     }
+
+    for(int k = 0; k < nchunks; k++){
+        MPI_Type_free(&send_types[k]);
+    }
+    MPI_Type_free(&recv_type);
+    free(send_types);
+    free(sendcounts);
+    free(sdispls);
+    free(recvcounts);
+    free(rdispls);
+    free(done);
+    free(requests);
+}
+
+// Function to compute and transpose a distributed stack of square matrices
+// nchunks = 0 performs the work and then one blocking transpose, otherwise
+// the work is pipelined with the exchange (see transpose_mpi_overlap)
+void compute_and_transpose(cplx* v, cplx* send, cplx* recv, int n, int nb, const int* row_counts, const int* row_displs, int nchunks,
+                           chunk_work_t* work, MPI_Comm comm){
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    if(nchunks > 0){
+        transpose_mpi_overlap(v, send, recv, n, nb, row_counts, row_displs, nchunks, chunk_compute, work, comm);
+    } else {
+        for(int b = 0; b < nb; b++){
+            chunk_compute(v + (size_t)b * row_counts[rank] * n, 0, row_counts[rank], work);
+        }
+        transpose_mpi(v, send, recv, n, nb, row_counts, row_displs, comm);
+    }
+}
+
+// Function to write the log-scaled magnitude of a distributed spectrum
+// The rows and columns are shifted the same way fftshift does while writing
+// filename = path of the image
+// v = local rows of the unshifted spectrum
+// n = number of columns (and rows) of the spectrum
+// first_row = global index of the first local row
+// num_rows = number of local rows
+// comm = communicator of the processes
+void write_spectrum(char* filename, const cplx* v, int n, int first_row, int num_rows, MPI_Comm comm){
+    double img_max_sq = spectrum_max_sq(v, (size_t)num_rows * n);
+    MPI_Allreduce(MPI_IN_PLACE, &img_max_sq, 1, MPI_DOUBLE, MPI_MAX, comm);
+
+    unsigned char* levels = (unsigned char*)malloc((size_t)num_rows * n + 1);
+    spectrum_log_u8(v, (size_t)num_rows * n, img_max_sq, levels);
+
+    unsigned char* shifted = (unsigned char*)malloc((size_t)num_rows * n + 1);
+    int* row_index = (int*)malloc((num_rows + 1) * sizeof(int));
+
+    // The rows from first_wrap on wrap around after the shift, they go
+    // first so the output rows are increasing
+    int first_wrap = n - n / 2 - first_row;
+    if(first_wrap < 0) first_wrap = 0;
+    if(first_wrap > num_rows) first_wrap = num_rows;
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i = 0; i < num_rows; i++){
+        int k = (i >= first_wrap) ? i - first_wrap : i + (num_rows - first_wrap);
+
+        row_index[k] = (first_row + i + n / 2) % n;
+        for(int j = 0; j < n; j++){
+            shifted[(size_t)k * n + j] = levels[(size_t)i * n + (j + n / 2) % n];
+        }
+    }
+
+    pgm_t spec;
+    strcpy(spec.type, "P2");
+    spec.width = n;
+    spec.height = n;
+    spec.max = 255;
+    spec.data = NULL;
+
+    pgm_mpi_write_rows_at_u8(comm, filename, spec, row_index, num_rows, shifted);
+
+    free(levels);
+    free(shifted);
+    free(row_index);
+}
+// Function to choose the number of OpenMP threads of each process and pin them
+// The number of threads comes from OMP_NUM_THREADS or, if it is not set, from the
+// cores the process was bound to by mpirun (e.g. --bind-to socket) or the cores of
+// the node divided by ranks_per_node. Each thread is pinned to its own core unless
+// OMP_PROC_BIND or OMP_PLACES are set
+// ranks_per_node = processes per node, 0 to count the processes sharing the node
+// funneled = 0 if MPI does not support MPI_THREAD_FUNNELED, then one thread is used
+// comm = communicator of the processes
+void setup_threads(int ranks_per_node, int funneled, MPI_Comm comm){
+#ifdef _OPENMP
+    MPI_Comm node;
+    int local_rank, local_size;
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node);
+    MPI_Comm_rank(node, &local_rank);
+    MPI_Comm_size(node, &local_size);
+    MPI_Comm_free(&node);
+
+    if(ranks_per_node <= 0){
+        ranks_per_node = local_size;
+    }
+
+    cpu_set_t mask;
+    sched_getaffinity(0, sizeof(mask), &mask);
+    int cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int bound = CPU_COUNT(&mask) < cores;
+
+    if(!funneled){
+        omp_set_num_threads(1);
+    } else if(getenv("OMP_NUM_THREADS") == NULL){
+        int threads = bound ? CPU_COUNT(&mask) : cores / ranks_per_node;
+        omp_set_num_threads((threads > 0) ? threads : 1);
+    }
+
+    if(getenv("OMP_PROC_BIND") != NULL || getenv("OMP_PLACES") != NULL){
+        return;
+    }
+
+    // Cores this process may run on, in order
+    int count = 0;
+    int* cpus = (int*)malloc(CPU_SETSIZE * sizeof(int));
+    for(int c = 0; c < CPU_SETSIZE; c++){
+        if(CPU_ISSET(c, &mask)){
+            cpus[count++] = c;
+        }
+    }
+
+    // Unbound processes on the same node take consecutive groups of cores
+    int base = bound ? 0 : (local_rank % ranks_per_node) * omp_get_max_threads();
+
+    #pragma omp parallel
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[(base + omp_get_thread_num()) % count], &set);
+        sched_setaffinity(0, sizeof(set), &set);
+    }
+
+    free(cpus);
+#else
+    (void)ranks_per_node;
+    (void)funneled;
+    (void)comm;
+#endif
+}
+
+
+// Function to choose the process grid of a stack of images
+// The images are split among dims[0] groups of processes and the rows of the
+// images of a group among its dims[1] processes. Groups need no communication
+// between them, so as many groups as possible are used
+// size = number of processes
+// num_images = number of images in the stack
+// dims = grid chosen by the user (both positive) or output grid
+void choose_grid(int size, int num_images, int* dims){
+    if(dims[0] > 0 && dims[1] > 0){
+        return;
+    }
+
+    dims[0] = 1;
+    for(int d = 1; d <= size && d <= num_images; d++){
+        if(size % d == 0){
+            dims[0] = d;
+        }
+    }
+    dims[1] = size / dims[0];
 }
 
-// Function to transpose a matrix in form of a vector
-// v = vector
-// width = number of columns
-// height = number of rows
-// return = transposed vector
-cplx* transpose(cplx* v, int width, int height){
-	cplx *tmp = (cplx*)malloc(height * width * sizeof(cplx));
-
-	for(int i = 0; i < height; i++){
-		for(int j = 0; j < width; j++){
-			tmp[j * height + i] = v[i * width + j];
-		}
-	}
-
-	return tmp;
+// Function to build the name of an output image
+// name = output string
+// prefix = name of the image without the extension
+// index = index of the image in the stack
+// num_images = number of images in the stack (a single image has no index)
+void output_name(char* name, const char* prefix, int index, int num_images){
+    if(num_images == 1){
+        sprintf(name, "%s.pgm", prefix);
+    } else {
+        sprintf(name, "%s_%d.pgm", prefix, index);
+    }
+}
+
+
+// Function to split a number of items among the processes
+// total = number of items
+// size = number of processes
+// counts = output, number of items of each process
+// displs = output, first item of each process
+void split_among(int total, int size, int* counts, int* displs){
+    int first = 0;
+    for(int p = 0; p < size; p++){
+        counts[p] = total / size + ((p < total % size) ? 1 : 0);
+        displs[p] = first;
+        first += counts[p];
+    }
 }
 
+// Function to filter a volume of slices in 3D, with the slices split in slabs among the processes
+// Each process does the 2D FFTs of its slab of slices. An all-to-all then
+// gives each process a slab of rows of every slice, where the FFTs along the
+// depth and the 3D filter need no communication, and a second all-to-all
+// brings the slabs of slices back for the 2D iFFTs
+// slices = paths of the slices, in order of depth
+// num_slices = number of slices
+// spec = filter, see filter_apply_3d
+// plan_mode = FFT_MEASURE or FFT_ESTIMATE
+// comm = communicator of the processes
+void filter_volume_mpi(char** slices, int num_slices, const filter_spec_t* spec, int plan_mode, MPI_Comm comm){
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    // Read the headers on the first process and share them
+    pgm_t img;
+    int header[4] = {0, 0, 0, 0};
+    if(rank == 0 && volume_read_header(slices, num_slices, &img) == 0){
+        header[0] = 1;
+        header[1] = img.width;
+        header[2] = img.height;
+        header[3] = img.max;
+    }
+    MPI_Bcast(header, 4, MPI_INT, 0, comm);
+
+    if(!header[0]){
+        if(rank == 0){
+            printf("Error opening file (as fatias devem ter o mesmo tamanho)\n");
+        }
+        MPI_Abort(comm, 1);
+    }
+    img.width = header[1];
+    img.height = header[2];
+    img.max = header[3];
+
+    // Size of the padded slices (square, power of 2) and of the padded depth
+    int n = nextPowerOf2(img.width);
+    if(nextPowerOf2(img.height) > n){
+        n = nextPowerOf2(img.height);
+    }
+    int depth = nextPowerOf2(num_slices);
+    size_t plane = (size_t)n * n;
+
+    // Slabs of slices and slabs of rows of each process
+    int* z_counts = (int*)malloc(size * sizeof(int));
+    int* z_displs = (int*)malloc(size * sizeof(int));
+    int* y_counts = (int*)malloc(size * sizeof(int));
+    int* y_displs = (int*)malloc(size * sizeof(int));
+    split_among(depth, size, z_counts, z_displs);
+    split_among(n, size, y_counts, y_displs);
+
+    int my_slices = z_counts[rank];
+    int my_first_slice = z_displs[rank];
+    int my_rows = y_counts[rank];
+    int my_first_row = y_displs[rank];
+
+    // Slices of this process that are in the stack, the others are zero padding
+    int live = num_slices - my_first_slice;
+    if(live > my_slices) live = my_slices;
+    if(live < 0) live = 0;
+
+    cplx* slab = (cplx*)calloc(my_slices * plane + 1, sizeof(cplx));
+    cplx* rows = (cplx*)malloc(((size_t)depth * my_rows * n + 1) * sizeof(cplx));
+    cplx* work = (cplx*)malloc((my_slices * plane + 1) * sizeof(cplx));
+
+    if(volume_read_slices(slices, my_first_slice, live, n, slab) != 0){
+        printf("Error opening file\n");
+        MPI_Abort(comm, 1);
+    }
+
+    // The messages are counted in rows of the slices
+    MPI_Datatype row_type;
+    MPI_Type_contiguous(n, MPI_CPLX, &row_type);
+    MPI_Type_commit(&row_type);
+
+    int* send_counts = (int*)malloc(size * sizeof(int));
+    int* send_displs = (int*)malloc(size * sizeof(int));
+    int* recv_counts = (int*)malloc(size * sizeof(int));
+    int* recv_displs = (int*)malloc(size * sizeof(int));
+
+    // Process p gets the rows of p of each local slice, and the rows of this
+    // process arrive by slice, so they are already in the order of the depth
+    for(int p = 0; p < size; p++){
+        send_counts[p] = my_slices * y_counts[p];
+        send_displs[p] = my_slices * y_displs[p];
+        recv_counts[p] = z_counts[p] * my_rows;
+        recv_displs[p] = z_displs[p] * my_rows;
+    }
+
+    fft_plan_t* plan = fft_plan_create(n, plan_mode);
+    fft_plan_t* depth_plan = fft_plan_create(depth, plan_mode);
+
+    //################# START 3D FFT #################
+    volume_fft_slices(plan, slab, live, 0);
+
+    // Pack the rows of each destination
+#ifdef _OPENMP
+    #pragma omp parallel for collapse(2)
+#endif
+    for(int p = 0; p < size; p++){
+        for(int z = 0; z < my_slices; z++){
+            memcpy(work + ((size_t)send_displs[p] + (size_t)z * y_counts[p]) * n,
+                   slab + z * plane + (size_t)y_displs[p] * n, (size_t)y_counts[p] * n * sizeof(cplx));
+        }
+    }
+
+    MPI_Alltoallv(work, send_counts, send_displs, row_type, rows, recv_counts, recv_displs, row_type, comm);
+
+    // FFT along the depth: the local rows of the slices are interleaved vectors
+    fft_execute_batch(depth_plan, rows, my_rows * n, 0);
+    //################# END 3D FFT #################
+
+    filter_apply_3d(rows, n, n, depth, my_first_row, my_rows, spec);
+
+    //################# START 3D iFFT #################
+    fft_execute_batch(depth_plan, rows, my_rows * n, 1);
+
+    // The exchange back is the same with the roles of the counts swapped
+    MPI_Alltoallv(rows, recv_counts, recv_displs, row_type, work, send_counts, send_displs, row_type, comm);
+
+#ifdef _OPENMP
+    #pragma omp parallel for collapse(2)
+#endif
+    for(int p = 0; p < size; p++){
+        for(int z = 0; z < my_slices; z++){
+            memcpy(slab + z * plane + (size_t)y_displs[p] * n,
+                   work + ((size_t)send_displs[p] + (size_t)z * y_counts[p]) * n, (size_t)y_counts[p] * n * sizeof(cplx));
+        }
+    }
+
+    volume_fft_slices(plan, slab, live, 1);
+    //################# END 3D iFFT #################
+
+    volume_write_slices(slab, my_first_slice, live, n, &img, 1.0 / ((double)plane * depth));
+
+    MPI_Type_free(&row_type);
+    free(slab);
+    free(rows);
+    free(work);
+    free(z_counts);
+    free(z_displs);
+    free(y_counts);
+    free(y_displs);
+    free(send_counts);
+    free(send_displs);
+    free(recv_counts);
+    free(recv_displs);
+    fft_plan_destroy(plan);
+    fft_plan_destroy(depth_plan);
+}
 
 int main(int argc, char** argv) {
 
     double start_time = MPI_Wtime();
 
     int rank, size;
-
+    int funneled = 1;
+
+#ifdef _OPENMP
+    // Only the main thread calls MPI, outside of the parallel regions
+    // Without MPI_THREAD_FUNNELED, setup_threads keeps one thread per process
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    if(provided < MPI_THREAD_FUNNELED){
+        printf("MPI_THREAD_FUNNELED not supported, using one thread per process\n");
+        funneled = 0;
+    }
+#else
     MPI_Init(&argc, &argv);
+#endif
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    pgm_t img;
+    cplx *v_local;
     cplx *v_send;
     cplx *v_revc;
-    int len_info[5];
 
-    if(rank == 0){
+    // Write the spectrum images only with --spectrum
+    // Pipeline the transposes in chunks of rows with --pipeline <chunks>
+    // Set the processes per node of a hybrid run with --ranks-per-node <ranks>
+    // Set the process grid of a stack of images with --grid <groups>x<processes>
+    // Plan without measuring the kernels with --estimate
+    // Filter the images as the slices of a volume, in 3D, with --volume
+    int write_spectra = 0;
+    int volume = 0;
+    int plan_mode = FFT_MEASURE;
+    int nchunks = 0;
+    int ranks_per_node = 0;
+    int dims[2] = {0, 0};
+    char** images = (char**)malloc(argc * sizeof(char*));
+    int num_images = 0;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--spectrum") == 0){
+            write_spectra = 1;
+        } else if(strcmp(argv[i], "--estimate") == 0){
+            plan_mode = FFT_ESTIMATE;
+        } else if(strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc){
+            nchunks = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--ranks-per-node") == 0 && i + 1 < argc){
+            ranks_per_node = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--volume") == 0){
+            volume = 1;
+        } else if(strcmp(argv[i], "--grid") == 0 && i + 1 < argc){
+            sscanf(argv[++i], "%dx%d", &dims[0], &dims[1]);
+        } else {
+            images[num_images++] = argv[i];
+        }
+    }
 
-        img = pgm_read(argv[1]);
+    if(volume && num_images > 0){
+        setup_threads(ranks_per_node, funneled, MPI_COMM_WORLD);
 
-        len_info[3] = img.width;
-        len_info[4] = img.height;
+        // Raio de corte do filtro passa-alta, igual ao da versao serial
+        filter_spec_t spec = {FILTER_HIGHPASS, 0.1, 0};
+        filter_volume_mpi(images, num_images, &spec, plan_mode, MPI_COMM_WORLD);
+        free(images);
 
-        // Check if padding is needed
-        if(!is_power_of_two(img.width*img.height) || img.width != img.height){
-            img = zeroPadding(img);
-        }
-       
-        len_info[0] = img.width;
-        len_info[1] = img.height;
-        len_info[2] = img.max;
-
-        // Allocate memory for the send vector
-        v_send = (cplx*)malloc(img.width * img.height * sizeof(cplx));
-        // Convert image to vector
-        v_send = mat2vet(img.data, img.width, img.height);
-
-    }
-
-    // Broadcast the usefull length information
-    MPI_Bcast(len_info, 5, MPI_INT, 0, MPI_COMM_WORLD);
-
-    // Find the number of rows per processor
-    int rows_per_processor = len_info[1] / size;
-    int remainder = len_info[1] % size;
-    
-    // Find the number of processors that will receive an extra row
-    int processors_with_extra_rows = (rank < remainder) ? 1 : 0;
-    
-    // Find the number of rows to send to this processor
-    int my_num_rows = rows_per_processor + processors_with_extra_rows;
-    
-    // Calculate the displacements for MPI_Scatterv
-    int* displacements = (int*)malloc(size * sizeof(int));
-    int* recvcounts = (int*)malloc(size * sizeof(int));
-
-    // Calculate the displacements and the recvcounts
-    int displacement = 0;
-    for (int i = 0; i < size; i++) {
-        recvcounts[i] = rows_per_processor * len_info[0];
-        if (i < remainder) {
-            recvcounts[i] += len_info[0]; // Distribute remaining rows
+        double elapsed = MPI_Wtime() - start_time;
+        MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &elapsed, &elapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+        if(rank == 0){
+            printf("Time: %.10lf\n", elapsed);
         }
-        displacements[i] = displacement;
-        displacement += recvcounts[i];
+
+        MPI_Finalize();
+        return 0;
     }
 
-    // Allocate memory for the received vector 
-    v_revc = (cplx*)malloc(my_num_rows * len_info[0] * sizeof(cplx));
+    choose_grid(size, num_images, dims);
 
-    // Scatter the data
-    MPI_Scatterv(v_send, recvcounts, displacements, MPI_C_DOUBLE_COMPLEX, v_revc, my_num_rows * len_info[0], MPI_C_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-    
-    //#################### Start 2D FFT ####################
-    // Perform 1D FFT
-    for(int i = 0; i < my_num_rows; i++)
-	{
-        cooley_tukey_fft(v_revc + i * len_info[0], len_info[0], 0);
+    if(num_images == 0 || dims[0] * dims[1] != size){
+        if(rank == 0){
+            printf("Uso: %s <imagem.pgm> [imagens...] [--grid <grupos>x<processos>] [--volume]\n", argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
     }
 
-    // Gather the data
-    MPI_Gatherv(v_revc, my_num_rows * len_info[0], MPI_C_DOUBLE_COMPLEX, v_send, recvcounts, displacements, MPI_C_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
+    setup_threads(ranks_per_node, funneled, MPI_COMM_WORLD);
 
-    if(rank == 0){
-        // Transpose
-        v_send = transpose(v_send, len_info[0], len_info[1]);
+    // Process grid: the first dimension splits the stack of images and the
+    // second one splits the rows of the images of a group
+    MPI_Comm grid, row_comm;
+    int periods[2] = {0, 0};
+    int keep_rows[2] = {0, 1};
+    int coords[2];
 
-    }
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &grid);
+    MPI_Cart_coords(grid, rank, 2, coords);
+    MPI_Cart_sub(grid, keep_rows, &row_comm);
 
-    // Scatter the data
-    MPI_Scatterv(v_send, recvcounts, displacements, MPI_C_DOUBLE_COMPLEX, v_revc, my_num_rows * len_info[0], MPI_C_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
+    int group_rank, group_size;
+    MPI_Comm_rank(row_comm, &group_rank);
+    MPI_Comm_size(row_comm, &group_size);
 
-    // Perform 1D FFT
-    for(int i = 0; i < my_num_rows; i++)
-	{
-        cooley_tukey_fft(v_revc + i * len_info[0], len_info[0], 0);
-    }
+    // Images of this group
+    int first_image = coords[0] * num_images / dims[0];
+    int nb = (coords[0] + 1) * num_images / dims[0] - first_image;
 
-    //#################### End 2D FFT ####################
+    // Read the headers on the first process of the group and share them
+    pgm_t* img = (pgm_t*)malloc(nb * sizeof(pgm_t));
+    MPI_Offset* data_offset = (MPI_Offset*)malloc(nb * sizeof(MPI_Offset));
 
-    // Gather the data
-    MPI_Gatherv(v_revc, my_num_rows * len_info[0], MPI_C_DOUBLE_COMPLEX, v_send, recvcounts, displacements, MPI_C_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
+    for(int b = 0; b < nb; b++){
+        data_offset[b] = pgm_mpi_read_header(row_comm, images[first_image + b], &img[b]);
 
-    if(rank == 0){
-        // Print the FFT image
-        img.data = vet2mat(fftshift(v_send, len_info[0], len_info[1]), len_info[0], len_info[1]);
-        
-        // Write FFT image
-        pgm_write_fft(img, "fft.pgm", "");
+        if(img[b].width != img[0].width || img[b].height != img[0].height){
+            printf("As imagens da pilha devem ter o mesmo tamanho\n");
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
 
-        v_send = ifftshift(mat2vet(img.data, len_info[0], len_info[1]), len_info[0], len_info[1]);
+    int o_width = (nb > 0) ? img[0].width : 1;
+    int o_height = (nb > 0) ? img[0].height : 1;
 
+    // Size of the padded image (square, power of 2)
+    int n = nextPowerOf2(o_width);
+    if(nextPowerOf2(o_height) > n){
+        n = nextPowerOf2(o_height);
     }
 
-    // Scatter the data
-    MPI_Scatterv(v_send, recvcounts, displacements, MPI_C_DOUBLE_COMPLEX, v_revc, my_num_rows * len_info[0], MPI_C_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
+    // Find the number of rows per processor of the group
+    int rows_per_processor = n / group_size;
+    int remainder = n % group_size;
 
-    //#################### Start 2D FFT ####################
-    // Perform 1D FFT
-    for(int i = 0; i < my_num_rows; i++)
-	{
-        cooley_tukey_fft(v_revc + i * len_info[0], len_info[0], 1);
+    // Calculate the rows of each processor and the first row of each one
+    int* row_counts = (int*)malloc(group_size * sizeof(int));
+    int* row_displs = (int*)malloc(group_size * sizeof(int));
+
+    int row = 0;
+    for (int i = 0; i < group_size; i++) {
+        row_counts[i] = rows_per_processor + ((i < remainder) ? 1 : 0); // Distribute remaining rows
+        row_displs[i] = row;
+        row += row_counts[i];
     }
 
-    // Gather the data
-    MPI_Gatherv(v_revc, my_num_rows * len_info[0], MPI_C_DOUBLE_COMPLEX, v_send, recvcounts, displacements, MPI_C_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
+    int my_num_rows = row_counts[group_rank];
+    int my_first_row = row_displs[group_rank];
+    size_t slab = (size_t)my_num_rows * n;
 
-    if(rank == 0){
-        // Transpose
-        v_send = transpose(v_send, len_info[0], len_info[1]);
-       
-    }
+    // Allocate memory for the local rows of every image and the transpose buffers
+    v_local = (cplx*)malloc((nb * slab + 1) * sizeof(cplx));
+    v_send = (cplx*)malloc((nb * slab + 1) * sizeof(cplx));
+    v_revc = (cplx*)malloc((nb * slab + 1) * sizeof(cplx));
 
-    // Scatter the data
-    MPI_Scatterv(v_send, recvcounts, displacements, MPI_C_DOUBLE_COMPLEX, v_revc, my_num_rows * len_info[0], MPI_C_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
-   
-    // Perform 1D FFT
-    for(int i = 0; i < my_num_rows; i++)
-	{
-        cooley_tukey_fft(v_revc + i * len_info[0], len_info[0], 1);
+    // Each processor reads its own rows of the padded images
+    for(int b = 0; b < nb; b++){
+        pgm_mpi_read_rows(row_comm, images[first_image + b], img[b], data_offset[b], my_first_row, my_num_rows, v_local + b * slab, n);
     }
 
-    //#################### End 2D FFT ####################
-    //(missing the division by the number of elements, we will do it after the gather)
+    // Plan of the 1D transforms of the rows
+    fft_plan_t* plan = fft_plan_create(n, plan_mode);
 
-    // Gather the data
-    MPI_Gatherv(v_revc, my_num_rows * len_info[0], MPI_C_DOUBLE_COMPLEX, v_send, recvcounts, displacements, MPI_C_DOUBLE_COMPLEX, 0, MPI_COMM_WORLD);
+    // Raio de corte do filtro passa-alta, igual ao da versao serial
+    double cutoff = 0.1 * n;
 
+    char name[64];
 
-    if(rank == 0){
+    //#################### Start 2D FFT ####################
+    // Perform 1D FFT and transpose
+    // The rows from o_height on are zero padding and stay zero
+    chunk_work_t rows_fft = {n, my_first_row, 1, -1.0, 0, plan, o_height};
+    compute_and_transpose(v_local, v_send, v_revc, n, nb, row_counts, row_displs, nchunks, &rows_fft, row_comm);
+
+    // The column FFT, the filter and the 1D iFFT are done on the same rows
+    // before the second transpose, without communication between them
+    chunk_work_t filter_ifft = {n, my_first_row, 1, cutoff, 1, plan, n};
+
+    if(write_spectra){
+        // Perform 1D FFT
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for(int i = 0; i < nb * my_num_rows; i++)
+        {
+            fft_execute(plan, v_local + (size_t)i * n, 0);
+        }
+
+        for(int b = 0; b < nb; b++){
+            output_name(name, "fft", first_image + b, num_images);
+            write_spectrum(name, v_local + b * slab, n, my_first_row, my_num_rows, row_comm);
 
-        // Divide by the number of elements
-        for(int i=0; i<len_info[0]*len_info[1]; i++){
-            v_send[i] /= (double)(len_info[0]*len_info[1]);
+            // Each processor filters its own rows using the global frequencies
+            highpass_filter(v_local + b * slab, n, n, my_first_row, my_num_rows, cutoff);
+
+            output_name(name, "filtered_fft", first_image + b, num_images);
+            write_spectrum(name, v_local + b * slab, n, my_first_row, my_num_rows, row_comm);
         }
 
-        img.data = vet2mat(v_send, len_info[0], len_info[1]);
+        filter_ifft.forward = 0;
+        filter_ifft.cutoff = -1.0;
+    }
+
+    //#################### End 2D FFT ####################
+
+    //#################### Start 2D iFFT ####################
+    // Perform 1D FFT, filter, perform 1D iFFT and transpose
+    compute_and_transpose(v_local, v_send, v_revc, n, nb, row_counts, row_displs, nchunks, &filter_ifft, row_comm);
+
+    // Rows of this processor that are inside the original image
+    int out_rows = o_height - my_first_row;
+    if(out_rows > my_num_rows) out_rows = my_num_rows;
+    if(out_rows < 0) out_rows = 0;
 
-        free(v_send);
+    unsigned char *pixels = (unsigned char*)malloc((size_t)out_rows * o_width + 1);
 
-        img.data = realloc(img.data, len_info[4] * sizeof(cplx*));
-        for (int i = 0; i < len_info[4]; i++) {
-            img.data[i] = realloc(img.data[i], len_info[3] * sizeof(cplx));
+    for(int b = 0; b < nb; b++){
+        cplx* v_img = v_local + b * slab;
+
+        // 16-bit images are written with 8 bits
+        pgm_t out = img[b];
+        double scale = 1.0 / ((double)n * n);
+        if(out.max > 255){
+            scale *= 255.0 / out.max;
+            out.max = 255;
         }
 
-        img.width = len_info[3];
-        img.height = len_info[4];
+        // Perform the last 1D iFFT only on the rows kept by the crop, then
+        // normalize, crop and convert to pixels while the row is in cache
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for(int i = 0; i < out_rows; i++){
+            fft_execute(plan, v_img + (size_t)i * n, 1);
+            spectrum_abs_u8(v_img + (size_t)i * n, o_width, scale, pixels + (size_t)i * o_width);
+        }
 
         // Write the ifft
-        pgm_write(img, "ifft.pgm", "");
-
-        free(img.data);
+        output_name(name, "ifft", first_image + b, num_images);
+        pgm_mpi_write_rows_u8(row_comm, name, out, out_rows, pixels);
     }
 
+    //#################### End 2D iFFT ####################
+
+    free(pixels);
+    free(v_local);
+    free(v_send);
     free(v_revc);
-    free(displacements);
-    free(recvcounts);
+    free(row_counts);
+    free(row_displs);
+    free(img);
+    free(data_offset);
+    free(images);
+    fft_plan_destroy(plan);
 
-    double end_time = MPI_Wtime();
+    MPI_Comm_free(&row_comm);
+    MPI_Comm_free(&grid);
+
+    // The time of the slowest group
+    double elapsed = MPI_Wtime() - start_time;
+    MPI_Reduce(rank == 0 ? MPI_IN_PLACE : &elapsed, &elapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
     if(rank == 0){
-        printf("Time: %.10lf\n", end_time - start_time);
+        printf("Time: %.10lf\n", elapsed);
     }
 
     MPI_Finalize();
     return 0;
 }
-
-
-
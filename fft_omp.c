@@ -4,41 +4,25 @@
 #include <complex.h>
 #include <math.h>
 #include "pgm.h"
+#include "fft_plan.h"
 #include "cshift.h"
+#include "spectrum.h"
+#include "spectrum_cache.h"
+#include "filter.h"
+#include "stream.h"
 #include <time.h>
+#include <sys/resource.h>
 #include <omp.h>
 
-#define PI 3.14159265358979323846
-
-typedef double complex cplx;
-
-// Function to convert a matrix in form of a vector
-// mat = matrix
-// width = number of columns
-// height = number of rows
-// return = vector
-cplx* mat2vet(cplx** mat, int width, int height){
-	cplx *v = (cplx*)malloc(height * width * sizeof(cplx));
-	for(int i = 0; i < height; i++){
-        for (int j = 0; j < width; j++){
-            v[i * width + j] = mat[i][j];
-        }
-    }
-	return v;
-}
-
-// Function to convert a vector in form of a matrix
+// Function to view a vector as a matrix, without copying
 // v = vector
 // width = number of columns
 // height = number of rows
-// return = matrix
-cplx** vet2mat(cplx* v, int width, int height){
+// return = pointers to the rows of v (only the pointers must be freed)
+cplx** rows_of(cplx* v, int width, int height){
 	cplx **mat = (cplx**)malloc(height * sizeof(cplx*));
 	for(int i = 0; i < height; i++){
-		mat[i] = (cplx*)malloc(width * sizeof(cplx));
-		for (int j = 0; j < width; j++){
-			mat[i][j] = v[i * width + j];
-		}
+		mat[i] = v + (size_t)i * width;
 	}
 	return mat;
 }
@@ -54,108 +38,66 @@ int nextPowerOf2(int num) {
     return power;
 }
 
-// Function to check if a number is a power of 2
-// x = number to check
-// return = 1 if x is a power of 2, 0 otherwise
-int is_power_of_two(int x)
-{
-    return (x != 0) && ((x & (x - 1)) == 0);
+// Function to get the peak memory of the process
+// return = peak resident set size in KB
+long peak_rss_kb(void){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
 }
 
-// Function to perform zero padding on an image
-// image = image to pad
-// return = padded image
-pgm_t zeroPadding(const pgm_t image) {
-
-    pgm_t paddedImage;
-    int newWidth = nextPowerOf2(image.width);
-    int newHeight = nextPowerOf2(image.height);
-
-    // If the image is not square, pad the image to make it square
-    if (newWidth != newHeight) {
-        newWidth = newHeight = (newWidth > newHeight) ? newWidth : newHeight;
+// Function to filter a spectrum with each filter spec and write the inverse images
+// The spectrum is computed once and shared read-only: each job filters its own
+// copy and does the inverse 2D FFT on it, and the jobs run in parallel
+// spectrum = unshifted n x n spectrum
+// n = number of rows and columns of the spectrum
+// o_width, o_height = size of the original image
+// max = maximum value of the output images
+// specs = filters
+// num_specs = number of filters, the outputs are results/ifft_<k>.pgm
+// plan = plan of the 1D transforms
+void filter_fan_out(const cplx* spectrum, int n, int o_width, int o_height, int max, const filter_spec_t* specs, int num_specs, const fft_plan_t* plan){
+    // 16-bit images are written with 8 bits
+    double scale = 1.0 / ((double)n * n);
+    if(max > 255){
+        scale *= 255.0 / max;
+        max = 255;
     }
 
-    // Allocate memory for the padded image
-    paddedImage.data = (cplx**)malloc(newHeight * sizeof(cplx*));
-    for (int i = 0; i < newHeight; i++) {
-        paddedImage.data[i] = (cplx*)calloc(newWidth, sizeof(cplx));
-    }
-
-    // Copy the image into the padded image
-    for (int i = 0; i < image.height; i++) {
-        for (int j = 0; j < image.width; j++) {
-            paddedImage.data[i][j] = image.data[i][j];
-        }
-    }
+    #pragma omp parallel
+    {
+        cplx *work = (cplx*)malloc((size_t)n * n * sizeof(cplx));
+        unsigned char *pixels = (unsigned char*)malloc((size_t)o_width * o_height);
+        char name[64];
+
+        #pragma omp for schedule(dynamic)
+        for(int k = 0; k < num_specs; k++){
+            memcpy(work, spectrum, (size_t)n * n * sizeof(cplx));
+            filter_apply(work, n, n, 0, n, &specs[k]);
+
+            // Perform 1D iFFT
+            for(int i = 0; i < n; i++){
+                fft_execute(plan, work + (size_t)i * n, 1);
+            }
 
-    // Copy the info of the image into the padded image
-    paddedImage.width = newWidth;
-    paddedImage.height = newHeight;
-    paddedImage.max = image.max;
-    strcpy(paddedImage.type, image.type);
+            // Transpose vector
+            fft_transpose_inplace(plan, work, n);
 
-    return paddedImage;
-}
+            // Perform 1D iFFT, normalize, crop and convert to pixels
+            for(int i = 0; i < o_height; i++){
+                fft_execute(plan, work + (size_t)i * n, 1);
+                spectrum_abs_u8(work + (size_t)i * n, o_width, scale, pixels + (size_t)i * o_width);
+            }
 
-// Function to perform Cooley-Tukey FFT
-// x = input vector
-// N = size of the input vector
-// Forwards if inverse = 0, backwards if inverse = 1
-void cooley_tukey_fft(cplx x[], int N, int inverse) {
-    // Bit-reversal permutation
-    int i, j, k;
-    for (i = 1, j = N / 2; i < N - 1; i++) {
-        if (i < j) {
-            cplx temp = x[i];
-            x[i] = x[j];
-            x[j] = temp;
+            sprintf(name, "results/ifft_%d.pgm", k);
+            pgm_write_u8(name, pixels, o_width, o_height, max);
         }
-        k = N / 2;
-        while (k <= j) {
-            j -= k;
-            k /= 2;
-        }
-        j += k;
-    }
 
-    // Iterative FFT or IFFT
-    double sign = (inverse) ? 1.0 : -1.0; // Sign for IFFT
-    for (int s = 1; s <= log2(N); s++) {
-        int m = 1 << s; // Subproblem size
-        cplx omega_m = cexp(sign * I * 2.0 * PI / m);
-
-        for (int k = 0; k < N; k += m) {
-            cplx omega = 1.0;
-
-            for (int j = 0; j < m / 2; j++) {
-                cplx t = omega * x[k + j + m / 2];
-                cplx u = x[k + j];
-                x[k + j] = u + t;
-                x[k + j + m / 2] = u - t;
-                omega *= omega_m;
-            }
-        }
+        free(work);
+        free(pixels);
     }
 }
 
-// Function to transpose a matrix in form of a vector
-// v = vector
-// width = number of columns
-// height = number of rows
-// return = transposed vector
-cplx* transpose(cplx* v, int width, int height){
-	cplx *tmp = (cplx*)malloc(height * width * sizeof(cplx));
-
-	for(int i = 0; i < height; i++){
-		for(int j = 0; j < width; j++){
-			tmp[j * height + i] = v[i * width + j];
-		}
-	}
-
-	return tmp;
-}
-
 
 int main(int argc, char** argv){
 
@@ -165,146 +107,217 @@ int main(int argc, char** argv){
     cplx* v_data;
     int o_width, o_height;
 
-    // Read image
-    img = pgm_read(argv[1]);
+    // Plan without measuring the kernels with --estimate
+    // Radius of the filter, as a fraction of the size, with --cutoff <fraction>
+    // Do not use the spectrum cache with --no-cache
+    // Write one image per filter with --filters <spec>,<spec>,... (hp:<r>, lp:<r>, bp:<r1>:<r2>)
+    // Filter the frames of stdin to stdout with --stream in place of the image
+    int plan_mode = FFT_MEASURE;
+    filter_spec_t *specs = NULL;
+    int num_specs = 0;
+    double cutoff_fraction = 0.1;
+    int use_cache = 1;
+    for(int i = 2; i < argc; i++){
+        if(strcmp(argv[i], "--estimate") == 0){
+            plan_mode = FFT_ESTIMATE;
+        } else if(strcmp(argv[i], "--cutoff") == 0 && i + 1 < argc){
+            cutoff_fraction = atof(argv[++i]);
+        } else if(strcmp(argv[i], "--no-cache") == 0){
+            use_cache = 0;
+        } else if(strcmp(argv[i], "--filters") == 0 && i + 1 < argc){
+            num_specs = filter_parse_specs(argv[++i], &specs);
+            if(num_specs < 0){
+                printf("Filtro inválido: %s (use hp:<r>, lp:<r> ou bp:<r1>:<r2>)\n", argv[i]);
+                exit(1);
+            }
+        }
+    }
+
+    if(strcmp(argv[1], "--stream") == 0){
+        // stdout carries the frames: the messages go to stderr
+        if(num_specs > 1){
+            fprintf(stderr, "Use um só filtro com --stream\n");
+            exit(1);
+        }
+        filter_spec_t spec = {FILTER_HIGHPASS, cutoff_fraction, 0};
+        if(num_specs == 1){
+            spec = specs[0];
+        }
+        free(specs);
+
+        stream_stats_t stats;
+        fft_stream(stdin, stdout, &spec, plan_mode, &stats);
+
+        fprintf(stderr, "Frames: %d\n", stats.frames);
+        fprintf(stderr, "Latency: %.3lf ms (mean), %.3lf ms (max)\n", stats.mean_ms, stats.max_ms);
+        fprintf(stderr, "Throughput: %.1lf frames/s\n", (stats.seconds > 0) ? stats.frames / stats.seconds : 0);
+        return 0;
+    }
+
+    // The forward spectrum of an image that was already transformed comes
+    // from the cache, and the pipeline starts at the filter
+    int n;
+    uint64_t key = (use_cache) ? spectrum_cache_key(argv[1]) : 0;
+    v_data = spectrum_cache_load(key, &img, &n);
+    int cached = (v_data != NULL);
+
+    if(!cached){
+        // Read header
+        FILE *fp = fopen(argv[1], "rb");
+        if(fp == NULL || pgm_read_header(fp, &img) != 0){
+            printf("Error opening file\n");
+            exit(1);
+        }
+
+        // Size of the padded image (square, power of 2)
+        n = nextPowerOf2(img.width);
+        if(nextPowerOf2(img.height) > n){
+            n = nextPowerOf2(img.height);
+        }
+
+        // Every stage works in place on this buffer: the image is read straight
+        // into the top left corner and the rest is the zero padding
+        v_data = (cplx*)calloc((size_t)n * n, sizeof(cplx));
+        pgm_read_data(fp, &img, v_data, n);
+        fclose(fp);
+    }
 
     o_height = img.height;
     o_width = img.width;
 
-    // Check if padding is needed
-    if(!is_power_of_two(img.width*img.height) || img.width != img.height){
-        img = zeroPadding(img);
-    }
+    img.width = n;
+    img.height = n;
 
-    // Convert image to vector
-    v_data = mat2vet(img.data, img.width, img.height);
+    // Plan of the 1D transforms of the rows
+    fft_plan_t *plan = fft_plan_create(img.width, plan_mode);
 
     //################# START 2D FFT #################
+    if(!cached){
+        //
+        //
+        // Perform 1D FFT
+        // The rows from o_height on are zero padding and stay zero: skip them
+        // Start parallel region
+        #pragma omp parallel for
+        for(int i=0; i < o_height; i++){
+            fft_execute(plan, v_data + i*img.width, 0);
+        }
 
-    //
-    //
-    // Perform 1D FFT
-    // Start parallel region
-    #pragma omp parallel for
-    for(int i=0; i < img.height; i++){
-        cooley_tukey_fft(v_data + i*img.width, img.width, 0);
-    }
+        // Transpose vector
+        fft_transpose_inplace(plan, v_data, img.width);
 
-    // Transpose vector
-    v_data = transpose(v_data, img.width, img.height);
+        //
+        //
+        // Perform 1D FFT
+        // Start parallel region
+        #pragma omp parallel for
+        for(int i=0; i < img.height; i++){
+            fft_execute(plan, v_data + i*img.width, 0);
+        }
 
-    //
-    //
-    // Perform 1D FFT
-    // Start parallel region
-    #pragma omp parallel for
-    for(int i=0; i < img.height; i++){
-        cooley_tukey_fft(v_data + i*img.width, img.width, 0);
+        pgm_t original = img;
+        original.width = o_width;
+        original.height = o_height;
+        spectrum_cache_store(key, &original, n, v_data);
     }
     //################# END 2D FFT #################
 
-    // Print the FFT image
-    img.data = vet2mat(fftshift(v_data, img.width, img.height), img.width, img.height);
+    // Aplicar fftshift para mover as baixas frequências para o centro na exibição
+    fftshift_inplace(v_data, img.width, img.height);
+
     // Write FFT image
+    img.data = rows_of(v_data, img.width, img.height);
     pgm_write_fft(img, "results/fft.pgm", "");
 
-    //################# START FILTERING #################
-    // Aplicar fftshift antes do filtro para mover as baixas frequências para o centro
-    v_data = fftshift(v_data, img.width, img.height);
+    // The filters work on the unshifted spectrum
+    fftshift_inplace(v_data, img.width, img.height);
 
-    // Definir raio de corte para o filtro passa-baixa
-    double cutoff = 0.1 * img.width;  // 20% do tamanho da imagem (ajustável)
+    if(num_specs > 0){
+        filter_fan_out(v_data, n, o_width, o_height, img.max, specs, num_specs, plan);
 
-    // Criar e aplicar a máscara do filtro passa-baixa
-    int cx = img.width / 2;  // Centro X
-    int cy = img.height / 2; // Centro Y
+        free(specs);
+        free(img.data);
+        if(cached){
+            spectrum_cache_release(v_data, n);
+        } else {
+            free(v_data);
+        }
+        fft_plan_destroy(plan);
 
-    #pragma omp parallel //Região Paralela ---------------------------------------------------------------------------------------------------
-    {
-        // double start = omp_get_wtime();
+        int end = clock();
 
-        #pragma omp for collapse(2)
-        for (int y = 0; y < img.height; y++) {
-            for (int x = 0; x < img.width; x++) {
-                // Distância do centro da imagem FFT
-                double dist = sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy));
-    
-                // Se estiver FORA do raio de corte, zera
-                if (dist < cutoff) {
-                    v_data[y * img.width + x] = 0;
-                }
-            }
-        }
-        // double end = omp_get_wtime();
-        // printf("tempo paralelo: %f\n", end - start);
+        printf("Time: %.10lf\n", (double)(end - start) / CLOCKS_PER_SEC);
+        printf("Peak RSS: %ld KB\n", peak_rss_kb());
+        return 0;
     }
 
-    // Criar imagem FFT filtrada para salvar
-    pgm_t filtered_fft_img;
-    filtered_fft_img.width = img.width;
-    filtered_fft_img.height = img.height;
-    filtered_fft_img.max = img.max;
-    strcpy(filtered_fft_img.type, img.type);
+    //################# START FILTERING #################
 
-    // Salvar a FFT filtrada (após fftshift para exibição correta)
-    filtered_fft_img.data = vet2mat(v_data, img.width, img.height);
-    pgm_write_fft(filtered_fft_img, "results/filtered_fft.pgm", "");
+    // Filtro passa-alta padrão, com o mesmo filter_apply de --filters
+    // Raio de corte: 10% do tamanho da imagem por padrão (--cutoff)
+    filter_spec_t spec = {FILTER_HIGHPASS, cutoff_fraction, 0};
+
+    #pragma omp parallel for
+    for(int i = 0; i < img.height; i++){
+        filter_apply(v_data + (size_t)i * img.width, img.width, img.height, i, 1, &spec);
+    }
 
-    // Desfazer o shift para voltar ao domínio correto antes da IFFT
-    // v_data = ifftshift(v_data, img.width, img.height);
+    // Aplicar fftshift para exibição
+    fftshift_inplace(v_data, img.width, img.height);
 
-    // Liberar memória
-    free(filtered_fft_img.data);
+    // Salvar a FFT filtrada (após fftshift para exibição correta)
+    pgm_write_fft(img, "results/filtered_fft.pgm", "");
+
+    free(img.data);
 
     //################# END FILTERING #################
 
-    // Aplicar o shift para voltar ao domínio correto
-    // Comentar para para reconstruir a imagem a partir do v_data alterado (usar o filtro)
-    // v_data = ifftshift(mat2vet(img.data, img.width, img.height), img.width, img.height);
+    // A reconstrução usa o v_data filtrado e ainda deslocado: o deslocamento
+    // só muda a fase, e a imagem final é o módulo
 
     //################# START 2D iFFT #################
-
     // Perform 1D iFFT
     for(int i=0; i < img.height; i++){
-        cooley_tukey_fft(v_data + i*img.width, img.width, 1);
+        fft_execute(plan, v_data + i*img.width, 1);
     }
 
     // Transpose vector
-    v_data = transpose(v_data, img.width, img.height);
+    fft_transpose_inplace(plan, v_data, img.width);
 
     // Perform 1D iFFT
-    for(int i=0; i < img.height; i++){
-        cooley_tukey_fft(v_data + i*img.width, img.width, 1);
+    // Only the rows before o_height are kept: each one is normalized, cropped
+    // and converted to pixels while it is still in cache
+    unsigned char *pixels = (unsigned char*)malloc((size_t)o_width * o_height);
+
+    // 16-bit images are written with 8 bits
+    double scale = 1.0 / ((double)img.width * img.height);
+    if(img.max > 255){
+        scale *= 255.0 / img.max;
+        img.max = 255;
     }
 
-    // Divide by the number of pixels   
-    for(int i=0; i < img.width*img.height; i++){
-        v_data[i] /= (img.height*img.width);
+    #pragma omp parallel for
+    for(int i=0; i < o_height; i++){
+        fft_execute(plan, v_data + i*img.width, 1);
+        spectrum_abs_u8(v_data + i*img.width, o_width, scale, pixels + (size_t)i*o_width);
     }
     //################# END 2D iFFT #################
 
-    // Convert vector to matrix
-    img.data = vet2mat(v_data, img.width, img.height);
-
-    free(v_data);
-
-    // Realloc
-    img.data = (cplx**)realloc(img.data, o_height * sizeof(cplx*));
-    for (int i = 0; i < o_height; i++) {
-        img.data[i] = (cplx*)realloc(img.data[i], o_width * sizeof(cplx));
-    }
-
-    img.width = o_width;
-    img.height = o_height;
-
     // Write inverse FFT image
-    pgm_write(img, "results/ifft.pgm", "");
+    pgm_write_u8("results/ifft.pgm", pixels, o_width, o_height, img.max);
     
-    free(img.data);
+    free(pixels);
+    if(cached){
+        spectrum_cache_release(v_data, n);
+    } else {
+        free(v_data);
+    }
+    fft_plan_destroy(plan);
 
     int end = clock();
 
     printf("Time: %.10lf\n", (double)(end - start) / CLOCKS_PER_SEC);
+    printf("Peak RSS: %ld KB\n", peak_rss_kb());
     return 0;
 
-}
\ No newline at end of file
+}
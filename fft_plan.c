@@ -0,0 +1,1068 @@
+#define _POSIX_C_SOURCE 200809L
+#include "fft_plan.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <complex.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define PI 3.14159265358979323846
+
+// Smallest size that gets the sub-plans of the four-step kernel
+#define FOURSTEP_MIN 1024
+
+// Columns gathered at a time by the four-step kernel
+#define FOURSTEP_COLS 16
+
+// Largest block of the recursive kernel that is done iteratively
+#define DIF_BASE 1024
+
+// Lanes of the batched transforms that go through all the stages together
+#ifndef BATCH_LANES
+#define BATCH_LANES 32
+#endif
+
+// Function to perform Cooley-Tukey FFT
+// x = input vector
+// N = size of the input vector
+// Forwards if inverse = 0, backwards if inverse = 1
+void cooley_tukey_fft(cplx x[], int N, int inverse) {
+    // Bit-reversal permutation
+    int i, j, k;
+    for (i = 1, j = N / 2; i < N - 1; i++) {
+        if (i < j) {
+            cplx temp = x[i];
+            x[i] = x[j];
+            x[j] = temp;
+        }
+        k = N / 2;
+        while (k <= j) {
+            j -= k;
+            k /= 2;
+        }
+        j += k;
+    }
+
+    // Iterative FFT or IFFT
+    // The twiddle factors are kept in double precision even when cplx is float
+    double sign = (inverse) ? 1.0 : -1.0; // Sign for IFFT
+    for (int s = 1; s <= log2(N); s++) {
+        int m = 1 << s; // Subproblem size
+        double complex omega_m = cexp(sign * I * 2.0 * PI / m);
+
+        for (int k = 0; k < N; k += m) {
+            double complex omega = 1.0;
+
+            for (int j = 0; j < m / 2; j++) {
+                cplx t = (cplx)omega * x[k + j + m / 2];
+                cplx u = x[k + j];
+                x[k + j] = u + t;
+                x[k + j + m / 2] = u - t;
+                omega *= omega_m;
+            }
+        }
+    }
+}
+
+// Function to perform one decimation-in-frequency stage on the blocks of a vector
+// x = vector of n elements
+// n = size of the vector
+// m = size of the blocks of the stage
+// tw = twiddle table with exp(-2 pi i j step / m) at j * step, or NULL to
+// compute the twiddles by recurrence
+// step = stride of the stage's twiddles in the table
+// inverse = use the conjugated twiddles
+static void _dif_stage(cplx *x, int n, int m, const real_t *tw, int step, int inverse){
+    int half = m / 2;
+    real_t *d = (real_t*)x;
+
+    // The twiddle factors are kept in double precision, as in cooley_tukey_fft
+    double complex omega_m = (tw == NULL) ? cexp(((inverse) ? 1.0 : -1.0) * I * 2.0 * PI / m) : 0;
+    double complex omega = 1.0;
+    real_t sign = (inverse) ? -1 : 1;
+
+    for(int j = 0; j < half; j++){
+        real_t wr, wi;
+        if(tw != NULL){
+            wr = tw[2 * j * step];
+            wi = sign * tw[2 * j * step + 1];
+        } else {
+            wr = creal(omega);
+            wi = cimag(omega);
+            omega *= omega_m;
+        }
+
+        for(int k = 0; k < n; k += m){
+            int a = 2 * (k + j);
+            int b = 2 * (k + j + half);
+
+            real_t dr = d[a] - d[b];
+            real_t di = d[a + 1] - d[b + 1];
+
+            d[a] += d[b];
+            d[a + 1] += d[b + 1];
+            d[b] = wr * dr - wi * di;
+            d[b + 1] = wr * di + wi * dr;
+        }
+    }
+}
+
+// Function to perform the recursive decimation-in-frequency stages
+// Each level does its butterflies and recurses on the two halves, so the
+// blocks get smaller until they fit in cache, whatever the cache size is.
+// Below DIF_BASE the remaining stages are done iteratively
+// The output is in bit-reversed order
+static void _dif_recursive(cplx *x, int n, const real_t *tw, int step, int inverse){
+    if(n <= DIF_BASE){
+        for(int m = n; m >= 2; m /= 2){
+            _dif_stage(x, n, m, tw, step * (n / m), inverse);
+        }
+        return;
+    }
+
+    _dif_stage(x, n, n, tw, step, inverse);
+    _dif_recursive(x, n / 2, tw, 2 * step, inverse);
+    _dif_recursive(x + n / 2, n / 2, tw, 2 * step, inverse);
+}
+
+// Function to perform a recursive in-place FFT, without allocating memory
+// Same interface as cooley_tukey_fft
+// x = input vector
+// N = size of the input vector
+// Forwards if inverse = 0, backwards if inverse = 1
+void recursive_fft(cplx x[], int N, int inverse){
+    _dif_recursive(x, N, NULL, 1, inverse);
+
+    // Bit-reversal permutation of the output
+    int i, j, k;
+    for (i = 1, j = N / 2; i < N - 1; i++) {
+        if (i < j) {
+            cplx temp = x[i];
+            x[i] = x[j];
+            x[j] = temp;
+        }
+        k = N / 2;
+        while (k <= j) {
+            j -= k;
+            k /= 2;
+        }
+        j += k;
+    }
+}
+
+// Function to reorder a vector with the bit-reversal table of the plan
+static void _bit_reverse(const fft_plan_t *plan, cplx *x){
+    for(int i = 0; i < plan->n; i++){
+        int j = plan->bitrev[i];
+        if(i < j){
+            cplx temp = x[i];
+            x[i] = x[j];
+            x[j] = temp;
+        }
+    }
+}
+
+// Function to perform the radix-2 stages of subproblem size first_m to n
+// The input must be in bit-reversed order with the smaller stages already done
+// plan = plan with the twiddle table
+// x = vector
+// first_m = subproblem size of the first stage
+// inverse = use the conjugated twiddles
+static void _radix2_stages(const fft_plan_t *plan, cplx *x, int first_m, int inverse){
+    int n = plan->n;
+    real_t *d = (real_t*)x;
+    const real_t *tw = (const real_t*)plan->twiddles;
+    real_t sign = (inverse) ? -1 : 1;
+
+    for(int m = first_m; m <= n; m *= 2){
+        int half = m / 2;
+        int step = n / m;
+
+        for(int k = 0; k < n; k += m){
+            for(int j = 0; j < half; j++){
+                real_t wr = tw[2 * j * step];
+                real_t wi = sign * tw[2 * j * step + 1];
+
+                int a = 2 * (k + j);
+                int b = 2 * (k + j + half);
+
+                real_t tr = wr * d[b] - wi * d[b + 1];
+                real_t ti = wr * d[b + 1] + wi * d[b];
+
+                d[b] = d[a] - tr;
+                d[b + 1] = d[a + 1] - ti;
+                d[a] += tr;
+                d[a + 1] += ti;
+            }
+        }
+    }
+}
+
+// The radix-2 kernels take powers of 2, the other sizes go to Bluestein
+static int _is_pow2(int n){
+    return n >= 1 && (n & (n - 1)) == 0;
+}
+
+static int _supports_any(int n){
+    return _is_pow2(n);
+}
+
+static int _supports_codelet(int n){
+    return _is_pow2(n) && n >= fft_codelets[0].n;
+}
+
+// Kernel: the original iterative Cooley-Tukey
+static void _cooley_tukey(const fft_plan_t *plan, cplx *x, int inverse){
+    cooley_tukey_fft(x, plan->n, inverse);
+}
+
+// Kernel: bit reversal from a table, the first stages with the largest
+// generated codelet on each block and the remaining stages with a twiddle table
+static void _codelet_fft(const fft_plan_t *plan, cplx *x, int inverse){
+    const codelet_t *c = plan->codelet;
+    codelet_fn f = (inverse) ? c->inverse : c->forward;
+
+    _bit_reverse(plan, x);
+
+    for(int k = 0; k < plan->n; k += c->n){
+        f(x + k);
+    }
+
+    _radix2_stages(plan, x, 2 * c->n, inverse);
+}
+
+// Kernel: recursive decimation in frequency with the twiddle table of the plan
+static void _recursive_fft(const fft_plan_t *plan, cplx *x, int inverse){
+    _dif_recursive(x, plan->n, (const real_t*)plan->twiddles, 1, inverse);
+    _bit_reverse(plan, x);
+}
+
+// Scratch vectors of the out-of-place kernels, one set per thread
+// Slot 0 is used by the 1D kernels, slot 1 by the four-step kernel and slot 2
+// by the Bluestein kernel, whose sub-transforms may need the other slots at
+// the same time. The sub-plans of the four-step kernel never use four-step
+// themselves (see fft_plan_create), so slot 1 is never nested
+static __thread cplx *_scratch[3] = {NULL, NULL, NULL};
+static __thread int _scratch_n[3] = {0, 0, 0};
+
+static cplx* _get_scratch(int slot, int n){
+    if(_scratch_n[slot] < n){
+        free(_scratch[slot]);
+        _scratch[slot] = (cplx*)malloc(n * sizeof(cplx));
+        _scratch_n[slot] = n;
+    }
+    return _scratch[slot];
+}
+
+static int _supports_stockham(int n){
+    return _is_pow2(n) && n >= 2;
+}
+
+// Kernel: radix-2 Stockham autosort. Each stage reads one vector and writes
+// the other with unit stride, and the output comes out in natural order, so
+// there is no bit-reversal pass
+static void _stockham_fft(const fft_plan_t *plan, cplx *x, int inverse){
+    int n = plan->n;
+    real_t *src = (real_t*)x;
+    real_t *dst = (real_t*)_get_scratch(0, n);
+    const real_t *tw = (const real_t*)plan->twiddles;
+    real_t sign = (inverse) ? -1 : 1;
+
+    // l butterflies groups of m consecutive elements per stage
+    for(int l = n / 2, m = 1; l >= 1; l /= 2, m *= 2){
+        int step = n / (2 * l);
+
+        for(int j = 0; j < l; j++){
+            real_t wr = tw[2 * j * step];
+            real_t wi = sign * tw[2 * j * step + 1];
+
+            const real_t *a = src + 2 * j * m;
+            const real_t *b = src + 2 * (j + l) * m;
+            real_t *ya = dst + 4 * j * m;
+            real_t *yb = dst + 2 * (2 * j + 1) * m;
+
+            for(int k = 0; k < 2 * m; k += 2){
+                real_t dr = a[k] - b[k];
+                real_t di = a[k + 1] - b[k + 1];
+
+                ya[k] = a[k] + b[k];
+                ya[k + 1] = a[k + 1] + b[k + 1];
+                yb[k] = wr * dr - wi * di;
+                yb[k + 1] = wr * di + wi * dr;
+            }
+        }
+
+        real_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    // An odd number of stages leaves the result in the scratch vector
+    if(src != (real_t*)x){
+        memcpy(x, src, n * sizeof(cplx));
+    }
+}
+
+static int _supports_fourstep(int n){
+    return _is_pow2(n) && n >= FOURSTEP_MIN;
+}
+
+// Kernel: four-step for long rows
+// The row is seen as n1 rows of n2 elements. The columns are transformed in
+// blocks of FOURSTEP_COLS gathered into a buffer, twiddled and put back, then
+// the rows are transformed and one transpose gives the natural order. Every
+// transform fits in cache, and each batch of them is split among the OpenMP
+// threads, so a single long row is also computed in parallel
+static void _fourstep_fft(const fft_plan_t *plan, cplx *x, int inverse){
+    int n = plan->n;
+    int n1 = plan->sub[0]->n;
+    int n2 = plan->sub[1]->n;
+    real_t sign = (inverse) ? -1 : 1;
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int c0 = 0; c0 < n2; c0 += FOURSTEP_COLS){
+        cplx *buf = _get_scratch(1, n1 * FOURSTEP_COLS);
+
+        for(int r = 0; r < n1; r++){
+            for(int b = 0; b < FOURSTEP_COLS; b++){
+                buf[b * n1 + r] = x[(size_t)r * n2 + c0 + b];
+            }
+        }
+
+        for(int b = 0; b < FOURSTEP_COLS; b++){
+            cplx *col = buf + b * n1;
+            fft_execute(plan->sub[0], col, inverse);
+
+            real_t *d = (real_t*)col;
+            const real_t *tw = (const real_t*)(plan->steptw + (size_t)(c0 + b) * n1);
+            for(int k = 0; k < 2 * n1; k += 2){
+                real_t wr = tw[k];
+                real_t wi = sign * tw[k + 1];
+                real_t re = d[k];
+                d[k] = wr * re - wi * d[k + 1];
+                d[k + 1] = wr * d[k + 1] + wi * re;
+            }
+        }
+
+        for(int r = 0; r < n1; r++){
+            for(int b = 0; b < FOURSTEP_COLS; b++){
+                x[(size_t)r * n2 + c0 + b] = buf[b * n1 + r];
+            }
+        }
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int r = 0; r < n1; r++){
+        fft_execute(plan->sub[1], x + (size_t)r * n2, inverse);
+    }
+
+    cplx *s = _get_scratch(1, n);
+    fft_transpose(plan, x, s, n2, n1);
+    memcpy(x, s, n * sizeof(cplx));
+}
+
+static int _supports_bluestein(int n){
+    return n >= 1 && !_is_pow2(n);
+}
+
+// Kernel: Bluestein, for the sizes that are not powers of 2
+// With c[j] = exp(-pi i j^2 / n), the transform is X[k] = c[k] * sum x[j] c[j] conj(c[k - j]),
+// a convolution with the conjugate chirp, done with transforms of the padded
+// size m >= 2n - 1 (a power of 2) and the spectrum of the chirp computed by
+// fft_plan_create. The inverse is the conjugate of the transform of the conjugate
+static void _bluestein_fft(const fft_plan_t *plan, cplx *x, int inverse){
+    int n = plan->n;
+    int m = plan->sub[0]->n;
+    cplx *buf = _get_scratch(2, m);
+
+    for(int j = 0; j < n; j++){
+        buf[j] = ((inverse) ? conj(x[j]) : x[j]) * plan->chirp[j];
+    }
+    memset(buf + n, 0, (m - n) * sizeof(cplx));
+
+    fft_execute(plan->sub[0], buf, 0);
+    for(int k = 0; k < m; k++){
+        buf[k] *= plan->chirp_spectrum[k];
+    }
+    fft_execute(plan->sub[0], buf, 1);
+
+    for(int k = 0; k < n; k++){
+        cplx y = buf[k] * plan->chirp[k];
+        x[k] = (inverse) ? conj(y) : y;
+    }
+}
+
+const fft_kernel_t fft_kernels[] = {
+    {"cooley_tukey", _supports_any, _cooley_tukey},
+    {"codelet", _supports_codelet, _codelet_fft},
+    {"stockham", _supports_stockham, _stockham_fft},
+    {"fourstep", _supports_fourstep, _fourstep_fft},
+    {"recursive", _supports_any, _recursive_fft},
+    {"bluestein", _supports_bluestein, _bluestein_fft},
+};
+
+const int fft_num_kernels = sizeof(fft_kernels) / sizeof(fft_kernels[0]);
+
+// Wisdom: the best kernel and transpose tile of each size on this machine,
+// one "<kind> <precision> <n> <choice>" entry per line. Later lines win
+typedef struct wisdom{
+    char kind[16];
+    int n;
+    char choice[32];
+}wisdom_t;
+
+static wisdom_t *_wisdom = NULL;
+static int _wisdom_count = -1;
+
+static const char* _precision(void){
+    return (sizeof(real_t) == sizeof(float)) ? "float" : "double";
+}
+
+// Function to find the wisdom file: $FFT_WISDOM, or projeto_fft/wisdom inside
+// $XDG_CACHE_HOME or ~/.cache. The directories are created if create is set
+// path = output path
+// size = size of path
+// return = 0 on success, -1 if there is no place for the file
+static int _wisdom_path(char *path, size_t size, int create){
+    const char *env = getenv("FFT_WISDOM");
+    if(env != NULL){
+        snprintf(path, size, "%s", env);
+        return 0;
+    }
+
+    char dir[1024];
+    const char *cache = getenv("XDG_CACHE_HOME");
+    if(cache != NULL && cache[0] != '\0'){
+        snprintf(dir, sizeof(dir), "%s", cache);
+    } else if(getenv("HOME") != NULL){
+        snprintf(dir, sizeof(dir), "%s/.cache", getenv("HOME"));
+        if(create) mkdir(dir, 0755);
+    } else {
+        return -1;
+    }
+
+    snprintf(path, size, "%s/projeto_fft", dir);
+    if(create) mkdir(path, 0755);
+
+    snprintf(path, size, "%s/projeto_fft/wisdom", dir);
+    return 0;
+}
+
+static void _wisdom_load(void){
+    if(_wisdom_count >= 0) return;
+    _wisdom_count = 0;
+
+    char path[1100];
+    if(_wisdom_path(path, sizeof(path), 0) != 0) return;
+
+    FILE *fp = fopen(path, "r");
+    if(fp == NULL) return;
+
+    char line[256];
+    wisdom_t w;
+    char precision[16];
+    while(fgets(line, sizeof(line), fp) != NULL){
+        if(sscanf(line, "%15s %15s %d %31s", w.kind, precision, &w.n, w.choice) == 4 && strcmp(precision, _precision()) == 0){
+            _wisdom = (wisdom_t*)realloc(_wisdom, (_wisdom_count + 1) * sizeof(wisdom_t));
+            _wisdom[_wisdom_count++] = w;
+        }
+    }
+
+    fclose(fp);
+}
+
+// Function to find the recorded choice of a size
+// return = choice, or NULL if the size was never measured
+static const char* _wisdom_lookup(const char *kind, int n){
+    _wisdom_load();
+
+    for(int i = _wisdom_count - 1; i >= 0; i--){
+        if(_wisdom[i].n == n && strcmp(_wisdom[i].kind, kind) == 0){
+            return _wisdom[i].choice;
+        }
+    }
+    return NULL;
+}
+
+// Function to record a choice in memory and append it to the wisdom file
+static void _wisdom_store(const char *kind, int n, const char *choice){
+    _wisdom_load();
+
+    wisdom_t w;
+    snprintf(w.kind, sizeof(w.kind), "%s", kind);
+    snprintf(w.choice, sizeof(w.choice), "%s", choice);
+    w.n = n;
+    _wisdom = (wisdom_t*)realloc(_wisdom, (_wisdom_count + 1) * sizeof(wisdom_t));
+    _wisdom[_wisdom_count++] = w;
+
+    char path[1100];
+    if(_wisdom_path(path, sizeof(path), 1) != 0) return;
+
+    FILE *fp = fopen(path, "a");
+    if(fp == NULL) return;
+
+    fprintf(fp, "%s %s %d %s\n", kind, _precision(), n, choice);
+    fclose(fp);
+}
+
+static double _now(void){
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Function to time a kernel on a plan
+// The drivers call the kernels inside their parallel row loops, so every
+// thread times its own vector at the same time. A kernel that is parallel
+// itself (four-step) then runs on one thread, as it does in the drivers
+// return = best time of a forward and an inverse transform, in seconds
+static double _time_kernel(fft_plan_t *plan, const fft_kernel_t *kernel){
+    int n = plan->n;
+
+    const fft_kernel_t *saved = plan->kernel;
+    plan->kernel = kernel;
+
+    // Enough repetitions for about a millisecond per measurement
+    int reps = 1 + (1 << 17) / n;
+    double best = 1e30;
+    double start = 0;
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        cplx *x = (cplx*)malloc(n * sizeof(cplx));
+
+        for(int trial = 0; trial < 3; trial++){
+            // Keep the values bounded
+            for(int i = 0; i < n; i++){
+                x[i] = (cplx)(i % 251);
+            }
+
+#ifdef _OPENMP
+            #pragma omp barrier
+            #pragma omp single
+#endif
+            start = _now();
+
+            for(int r = 0; r < reps; r++){
+                fft_execute(plan, x, 0);
+                fft_execute(plan, x, 1);
+            }
+
+#ifdef _OPENMP
+            #pragma omp barrier
+            #pragma omp single
+#endif
+            {
+                double elapsed = (_now() - start) / reps;
+                if(elapsed < best) best = elapsed;
+            }
+        }
+
+        free(x);
+    }
+
+    plan->kernel = saved;
+    return best;
+}
+
+// Function to time a transpose tile on a block of n columns
+// return = best time in seconds
+static double _time_tile(fft_plan_t *plan, int tile){
+    int n = plan->n;
+    int rows = (n < 128) ? n : 128;
+    cplx *in = (cplx*)calloc((size_t)n * rows, sizeof(cplx));
+    cplx *out = (cplx*)malloc((size_t)n * rows * sizeof(cplx));
+
+    int saved = plan->tile;
+    plan->tile = tile;
+
+    double best = 1e30;
+    for(int trial = 0; trial < 3; trial++){
+        double start = _now();
+        fft_transpose(plan, in, out, n, rows);
+        double elapsed = _now() - start;
+        if(elapsed < best) best = elapsed;
+    }
+
+    plan->tile = saved;
+    free(in);
+    free(out);
+    return best;
+}
+
+// Function to find a kernel by name
+// return = kernel, or NULL if it does not exist or does not support n
+static const fft_kernel_t* _find_kernel(const char *name, int n){
+    for(int i = 0; name != NULL && i < fft_num_kernels; i++){
+        if(strcmp(fft_kernels[i].name, name) == 0 && fft_kernels[i].supports(n)){
+            return &fft_kernels[i];
+        }
+    }
+    return NULL;
+}
+
+// Function to get the size of the L2 cache
+// return = size in bytes, 256 KB if the system does not tell
+long fft_l2_bytes(void){
+    long l2 = 0;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+    l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+    if(l2 <= 0) l2 = 256 * 1024;
+    return l2;
+}
+
+// Function to tell if a kernel may be used by a plan
+// The sub-plans of the four-step kernel run inside it and share its scratch
+// vector, so they never use four-step themselves
+// kernel = kernel, or NULL
+// inner = 1 for a sub-plan of the four-step kernel
+// return = kernel, or NULL if it is NULL or not allowed
+static const fft_kernel_t* _allowed(const fft_kernel_t *kernel, int inner){
+    if(kernel != NULL && inner && kernel->execute == _fourstep_fft){
+        return NULL;
+    }
+    return kernel;
+}
+
+// Function to choose a kernel without measuring
+// Rows that do not fit in the L2 cache use the Stockham kernel, whose stages
+// stream with unit stride, instead of paying for the scattered bit reversal.
+// Rows several times larger than L2 use the four-step kernel, whose passes
+// all fit in cache
+// inner = 1 for a sub-plan of the four-step kernel
+static const fft_kernel_t* _estimate_kernel(const fft_plan_t *plan, int inner){
+    if(!_is_pow2(plan->n)){
+        return _find_kernel("bluestein", plan->n);
+    }
+
+    long l2 = fft_l2_bytes();
+
+    long bytes = (long)plan->n * (long)sizeof(cplx);
+    if(bytes > 4 * l2 && !inner){
+        return _find_kernel("fourstep", plan->n);
+    }
+    if(bytes > l2){
+        return _find_kernel("stockham", plan->n);
+    }
+    if(plan->codelet != NULL){
+        return _find_kernel("codelet", plan->n);
+    }
+    return _find_kernel("cooley_tukey", plan->n);
+}
+
+// Function to choose the kernel and the transpose tile of a plan
+// Recorded wisdom is used when it exists. Otherwise FFT_MEASURE times every
+// candidate and records the winners, and FFT_ESTIMATE uses fixed rules.
+// The kernels of the sub-plans of four-step are recorded apart, as "inner"
+// inner = 1 for a sub-plan of the four-step kernel
+static void _plan_choose(fft_plan_t *plan, int mode, int inner){
+    int n = plan->n;
+    const char *kind = (inner) ? "inner" : "kernel";
+
+    // Kernel
+    const char *choice = _wisdom_lookup(kind, n);
+    const fft_kernel_t *kernel = _allowed(_find_kernel(choice, n), inner);
+
+    if(kernel == NULL && mode == FFT_MEASURE){
+        double best = 1e30;
+        for(int i = 0; i < fft_num_kernels; i++){
+            if(!fft_kernels[i].supports(n) || _allowed(&fft_kernels[i], inner) == NULL) continue;
+
+            double t = _time_kernel(plan, &fft_kernels[i]);
+            if(t < best){
+                best = t;
+                kernel = &fft_kernels[i];
+            }
+        }
+        _wisdom_store(kind, n, kernel->name);
+    }
+
+    if(kernel == NULL){
+        kernel = _estimate_kernel(plan, inner);
+    }
+    plan->kernel = kernel;
+
+    // Transpose tile
+    int tiles[] = {8, 16, 32, 64};
+    int num_tiles = sizeof(tiles) / sizeof(tiles[0]);
+
+    choice = _wisdom_lookup("tile", n);
+    if(choice != NULL){
+        plan->tile = atoi(choice);
+    } else if(mode == FFT_MEASURE){
+        double best = 1e30;
+        for(int i = 0; i < num_tiles; i++){
+            double t = _time_tile(plan, tiles[i]);
+            if(t < best){
+                best = t;
+                plan->tile = tiles[i];
+            }
+        }
+
+        char tile[16];
+        sprintf(tile, "%d", plan->tile);
+        _wisdom_store("tile", n, tile);
+    }
+}
+
+// Function to create a plan with its tables (bit reversal and twiddles) and
+// the radix-2 kernel, without sub-plans
+// n = size of the transform
+// return = plan
+static fft_plan_t* _plan_tables(int n){
+    fft_plan_t *plan = (fft_plan_t*)malloc(sizeof(fft_plan_t));
+    plan->n = n;
+    plan->tile = 32;
+
+    // Dispatch table: the largest generated codelet that fits
+    plan->codelet = NULL;
+    for(int i = 0; i < fft_num_codelets; i++){
+        if(fft_codelets[i].n <= n){
+            plan->codelet = &fft_codelets[i];
+        }
+    }
+
+    plan->kernel = &fft_kernels[0];
+
+    int bits = 0;
+    while((1 << bits) < n) bits++;
+
+    plan->bitrev = (int*)malloc(n * sizeof(int));
+    for(int i = 0; i < n; i++){
+        int r = 0;
+        for(int b = 0; b < bits; b++){
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        plan->bitrev[i] = r;
+    }
+
+    plan->twiddles = (cplx*)malloc((n / 2 + 1) * sizeof(cplx));
+    for(int j = 0; j < n / 2; j++){
+        plan->twiddles[j] = cexp(-I * 2.0 * PI * j / n);
+    }
+
+    plan->sub[0] = plan->sub[1] = NULL;
+    plan->steptw = NULL;
+    plan->chirp = plan->chirp_spectrum = NULL;
+
+    return plan;
+}
+
+// Function to create the plan of a transform or of a sub-plan of four-step
+// n, mode = see fft_plan_create
+// inner = 1 for a sub-plan of the four-step kernel, which never uses four-step
+// return = plan
+static fft_plan_t* _plan_create(int n, int mode, int inner){
+    fft_plan_t *plan = _plan_tables(n);
+
+    int bits = 0;
+    while((1 << bits) < n) bits++;
+
+    // Four-step: n1 = 2^(bits/2) and n2 = n / n1
+    if(n >= FOURSTEP_MIN && _is_pow2(n) && !inner){
+        int n1 = 1 << (bits / 2);
+        int n2 = n / n1;
+        plan->sub[0] = _plan_create(n1, mode, 1);
+        plan->sub[1] = _plan_create(n2, mode, 1);
+
+        plan->steptw = (cplx*)malloc(n * sizeof(cplx));
+        for(int r = 0; r < n2; r++){
+            for(int k = 0; k < n1; k++){
+                plan->steptw[(size_t)r * n1 + k] = cexp(-I * 2.0 * PI * (double)r * k / n);
+            }
+        }
+    }
+
+    // Bluestein: the chirp and the transform of its conjugate, already
+    // divided by m for the inverse of the convolution. j^2 is taken modulo 2n,
+    // which keeps the angles small and exact for big sizes
+    if(!_is_pow2(n)){
+        int m = 1;
+        while(m < 2 * n - 1) m *= 2;
+        plan->sub[0] = _plan_create(m, mode, 0);
+
+        plan->chirp = (cplx*)malloc(n * sizeof(cplx));
+        for(int j = 0; j < n; j++){
+            long long square = ((long long)j * j) % (2LL * n);
+            plan->chirp[j] = cexp(-I * PI * (double)square / n);
+        }
+
+        plan->chirp_spectrum = (cplx*)calloc(m, sizeof(cplx));
+        for(int j = 0; j < n; j++){
+            plan->chirp_spectrum[j] = conj(plan->chirp[j]) / m;
+            if(j > 0){
+                plan->chirp_spectrum[m - j] = plan->chirp_spectrum[j];
+            }
+        }
+        fft_execute(plan->sub[0], plan->chirp_spectrum, 0);
+    }
+
+    _plan_choose(plan, mode, inner);
+
+    return plan;
+}
+
+// Function to create the plan of a transform
+// n = size of the transform, the sizes that are not powers of 2 use Bluestein
+// mode = FFT_MEASURE or FFT_ESTIMATE
+// return = plan
+fft_plan_t* fft_plan_create(int n, int mode){
+    return _plan_create(n, mode, 0);
+}
+
+// Function to create the plan of fft_execute_batch and fft_execute_2d_batch
+// The batched transforms only use the bit reversal and the twiddles, so no
+// kernel is measured and no sub-plan is made
+// n = size of the transforms, a power of 2
+// return = plan
+fft_plan_t* fft_plan_create_batch(int n){
+    return _plan_tables(n);
+}
+
+// Function to perform the transform of a plan
+// plan = plan created for the size of x
+// x = input vector, overwritten with the transform
+// Forwards if inverse = 0, backwards if inverse = 1
+void fft_execute(const fft_plan_t *plan, cplx *x, int inverse){
+    plan->kernel->execute(plan, x, inverse);
+}
+
+// Function to perform a 2D transform of a matrix of any size
+// The spectrum is kept transposed (width rows of height elements), the layout
+// the row/transpose/row pipeline leaves it in; the inverse takes it that way
+// and gives the matrix back in its own layout. Neither is normalized
+// row_plan = plan of size width
+// col_plan = plan of size height
+// in = input, overwritten: height rows of width elements for the forward
+// transform, the transposed spectrum for the inverse
+// out = output, the transposed spectrum or the matrix
+// live_rows = forward: rows of in that are not all zero; inverse: rows of out
+// that are needed. The other rows are skipped
+// Forwards if inverse = 0, backwards if inverse = 1
+void fft_execute_2d(const fft_plan_t *row_plan, const fft_plan_t *col_plan, cplx *in, cplx *out, int live_rows, int inverse){
+    int width = row_plan->n;
+    int height = col_plan->n;
+
+    if(!inverse){
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for(int i = 0; i < live_rows; i++){
+            fft_execute(row_plan, in + (size_t)i * width, 0);
+        }
+
+        fft_transpose(row_plan, in, out, width, height);
+
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for(int i = 0; i < width; i++){
+            fft_execute(col_plan, out + (size_t)i * height, 0);
+        }
+    } else {
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for(int i = 0; i < width; i++){
+            fft_execute(col_plan, in + (size_t)i * height, 1);
+        }
+
+        fft_transpose(col_plan, in, out, height, width);
+
+#ifdef _OPENMP
+        #pragma omp parallel for
+#endif
+        for(int i = 0; i < live_rows; i++){
+            fft_execute(row_plan, out + (size_t)i * width, 1);
+        }
+    }
+}
+
+// Function to perform transforms of a plan on interleaved vectors
+// The lanes of an element are contiguous, so every butterfly is a loop over
+// the lanes with the same twiddle, which the compiler turns into SIMD
+// plan = plan of the size of the vectors, a power of 2
+// x = vectors, element j of lane l at x[j * stride + l]
+// stride = distance between the elements of a lane
+// lanes = number of vectors
+// Forwards if inverse = 0, backwards if inverse = 1
+static void _batch_fft(const fft_plan_t *plan, cplx *x, size_t stride, int lanes, int inverse){
+    int n = plan->n;
+    real_t *d = (real_t*)x;
+    int width = 2 * lanes;
+
+    // Bit reversal of whole elements (all the lanes)
+    for(int j = 0; j < n; j++){
+        int r = plan->bitrev[j];
+        if(j < r){
+            real_t *a = d + 2 * (size_t)j * stride;
+            real_t *b = d + 2 * (size_t)r * stride;
+            for(int l = 0; l < width; l++){
+                real_t temp = a[l];
+                a[l] = b[l];
+                b[l] = temp;
+            }
+        }
+    }
+
+    const real_t *tw = (const real_t*)plan->twiddles;
+    real_t sign = (inverse) ? -1 : 1;
+
+    for(int m = 2; m <= n; m *= 2){
+        int half = m / 2;
+        int step = n / m;
+
+        for(int k = 0; k < n; k += m){
+            for(int j = 0; j < half; j++){
+                real_t wr = tw[2 * j * step];
+                real_t wi = sign * tw[2 * j * step + 1];
+                real_t *a = d + 2 * (size_t)(k + j) * stride;
+                real_t *b = d + 2 * (size_t)(k + j + half) * stride;
+
+#ifdef _OPENMP
+                #pragma omp simd
+#endif
+                for(int l = 0; l < width; l += 2){
+                    real_t tr = wr * b[l] - wi * b[l + 1];
+                    real_t ti = wr * b[l + 1] + wi * b[l];
+                    real_t ar = a[l];
+                    real_t ai = a[l + 1];
+                    a[l] = ar + tr;
+                    a[l + 1] = ai + ti;
+                    b[l] = ar - tr;
+                    b[l + 1] = ai - ti;
+                }
+            }
+        }
+    }
+}
+
+// Function to perform the transforms of a plan on a batch of interleaved vectors
+// plan = plan of the size of the vectors, a power of 2
+// x = count vectors, element j of vector b at x[j * count + b]
+// count = number of vectors
+// Forwards if inverse = 0, backwards if inverse = 1
+void fft_execute_batch(const fft_plan_t *plan, cplx *x, int count, int inverse){
+    int blocks = (count + BATCH_LANES - 1) / BATCH_LANES;
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int blk = 0; blk < blocks; blk++){
+        int lanes = (count - blk * BATCH_LANES < BATCH_LANES) ? count - blk * BATCH_LANES : BATCH_LANES;
+        _batch_fft(plan, x + (size_t)blk * BATCH_LANES, count, lanes, inverse);
+    }
+}
+
+// Function to perform 2D transforms of a batch of matrices stored interleaved
+// (batch x height x width, with the batch as the fastest index)
+// The rows are batched transforms of count lanes and the columns batched
+// transforms of width * count lanes, so no transpose is needed and the
+// spectra stay in the layout of the matrices. The lanes are split in blocks
+// among the threads. Not normalized
+// row_plan = plan of size width, a power of 2
+// col_plan = plan of size height, a power of 2
+// v = count matrices, element (y, x) of matrix b at v[(y * width + x) * count + b]
+// count = number of matrices
+// Forwards if inverse = 0, backwards if inverse = 1
+void fft_execute_2d_batch(const fft_plan_t *row_plan, const fft_plan_t *col_plan, cplx *v, int count, int inverse){
+    int width = row_plan->n;
+    int height = col_plan->n;
+    size_t row = (size_t)width * count;
+
+    // Rows: height x blocks of the batch
+    int row_blocks = (count + BATCH_LANES - 1) / BATCH_LANES;
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int t = 0; t < height * row_blocks; t++){
+        int y = t / row_blocks;
+        int first = (t % row_blocks) * BATCH_LANES;
+        int lanes = (count - first < BATCH_LANES) ? count - first : BATCH_LANES;
+        _batch_fft(row_plan, v + y * row + first, count, lanes, inverse);
+    }
+
+    // Columns: blocks of the width x batch lanes
+    int col_blocks = (int)((row + BATCH_LANES - 1) / BATCH_LANES);
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int blk = 0; blk < col_blocks; blk++){
+        size_t first = (size_t)blk * BATCH_LANES;
+        int lanes = (row - first < BATCH_LANES) ? (int)(row - first) : BATCH_LANES;
+        _batch_fft(col_plan, v + first, row, lanes, inverse);
+    }
+}
+
+// Function to transpose a matrix in form of a vector, in square tiles
+// plan = plan with the tile size
+// in = matrix with height rows of width elements
+// out = transposed matrix (width rows of height elements)
+void fft_transpose(const fft_plan_t *plan, const cplx *in, cplx *out, int width, int height){
+    int tile = plan->tile;
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int ii = 0; ii < height; ii += tile){
+        for(int jj = 0; jj < width; jj += tile){
+            int i_end = (ii + tile < height) ? ii + tile : height;
+            int j_end = (jj + tile < width) ? jj + tile : width;
+
+            for(int i = ii; i < i_end; i++){
+                for(int j = jj; j < j_end; j++){
+                    out[(size_t)j * height + i] = in[(size_t)i * width + j];
+                }
+            }
+        }
+    }
+}
+
+// Function to transpose a square matrix in place, in square tiles
+// Each tile above the diagonal is swapped with its mirror tile
+// plan = plan with the tile size
+// v = matrix with n rows of n elements, overwritten with its transpose
+// n = number of rows and columns
+void fft_transpose_inplace(const fft_plan_t *plan, cplx *v, int n){
+    int tile = plan->tile;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for(int ii = 0; ii < n; ii += tile){
+        for(int jj = ii; jj < n; jj += tile){
+            int i_end = (ii + tile < n) ? ii + tile : n;
+            int j_end = (jj + tile < n) ? jj + tile : n;
+
+            for(int i = ii; i < i_end; i++){
+                for(int j = (ii == jj) ? i + 1 : jj; j < j_end; j++){
+                    cplx temp = v[(size_t)i * n + j];
+                    v[(size_t)i * n + j] = v[(size_t)j * n + i];
+                    v[(size_t)j * n + i] = temp;
+                }
+            }
+        }
+    }
+}
+
+void fft_plan_destroy(fft_plan_t *plan){
+    for(int i = 0; i < 2; i++){
+        if(plan->sub[i] != NULL) fft_plan_destroy(plan->sub[i]);
+    }
+    free(plan->steptw);
+    free(plan->chirp);
+    free(plan->chirp_spectrum);
+    free(plan->bitrev);
+    free(plan->twiddles);
+    free(plan);
+}
@@ -0,0 +1,63 @@
+#ifndef FFT_PLAN_H_
+#define FFT_PLAN_H_
+
+#include "pgm.h"
+#include "codelets.h"
+
+// Planner modes: FFT_MEASURE times the candidates the first time a size is
+// seen and records the winners in the wisdom file, FFT_ESTIMATE never measures
+#define FFT_MEASURE 0
+#define FFT_ESTIMATE 1
+
+struct fft_plan;
+
+// A 1D transform algorithm the planner can choose
+typedef struct fft_kernel{
+    const char *name;
+    int (*supports)(int);
+    void (*execute)(const struct fft_plan *, cplx *, int);
+}fft_kernel_t;
+
+// Everything a transform of size n needs, computed once
+typedef struct fft_plan{
+    int n;
+    const fft_kernel_t *kernel;
+    const codelet_t *codelet;   // largest codelet not bigger than n, or NULL
+    int *bitrev;                // bit-reversed index of each position
+    cplx *twiddles;             // exp(-2 pi i j / n) for j < n / 2
+    int tile;                   // tile size of fft_transpose
+    struct fft_plan *sub[2];    // four-step: plans of n1 and n2 = n / n1; Bluestein: plan of
+                                // the padded size in sub[0]; or NULL
+    cplx *steptw;               // four-step: exp(-2 pi i r k / n) at r * n1 + k
+    cplx *chirp;                // Bluestein: exp(-pi i j^2 / n), or NULL
+    cplx *chirp_spectrum;       // Bluestein: transform of the conjugate chirp divided by the padded size
+}fft_plan_t;
+
+extern const fft_kernel_t fft_kernels[];
+extern const int fft_num_kernels;
+
+void cooley_tukey_fft(cplx[], int, int);
+
+void recursive_fft(cplx[], int, int);
+
+fft_plan_t* fft_plan_create(int, int);
+
+fft_plan_t* fft_plan_create_batch(int);
+
+void fft_execute(const fft_plan_t *, cplx *, int);
+
+void fft_execute_2d(const fft_plan_t *, const fft_plan_t *, cplx *, cplx *, int, int);
+
+void fft_execute_batch(const fft_plan_t *, cplx *, int, int);
+
+void fft_execute_2d_batch(const fft_plan_t *, const fft_plan_t *, cplx *, int, int);
+
+void fft_transpose(const fft_plan_t *, const cplx *, cplx *, int, int);
+
+void fft_transpose_inplace(const fft_plan_t *, cplx *, int);
+
+void fft_plan_destroy(fft_plan_t *);
+
+long fft_l2_bytes(void);
+
+#endif
@@ -0,0 +1,126 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <complex.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "pgm.h"
+#include "fft_plan.h"
+#include "phasecorr.h"
+
+// Frames read and registered together
+#define FRAME_CHUNK 64
+
+// Function to read an image as real values
+// filename = path of the image
+// img = header of the image
+// return = img->height rows of img->width values, NULL if the image cannot be read
+real_t* read_real(char* filename, pgm_t* img){
+    FILE* fp = fopen(filename, "rb");
+    if(fp == NULL || pgm_read_header(fp, img) != 0){
+        if(fp != NULL) fclose(fp);
+        return NULL;
+    }
+
+    real_t* v = (real_t*)malloc((size_t)img->width * img->height * sizeof(real_t));
+    pgm_read_rows(fp, img, v, img->height);
+    fclose(fp);
+    return v;
+}
+
+// Function to get the peak memory of the process
+// return = peak resident set size in KB
+long peak_rss_kb(void){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+
+int main(int argc, char** argv){
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(argc < 3){
+        printf("Uso: %s <referência.pgm> <imagem.pgm> [imagens...] [--no-window] [--estimate]\n", argv[0]);
+        return 1;
+    }
+
+    // Plan without measuring the kernels with --estimate
+    // Do not apply the Hann window with --no-window (images that wrap around)
+    // The first image is the reference and the others are the frames
+    int plan_mode = FFT_MEASURE;
+    int window = 1;
+    char** paths = (char**)malloc(argc * sizeof(char*));
+    int num_paths = 0;
+
+    for(int i = 1; i < argc; i++){
+        if(strcmp(argv[i], "--estimate") == 0){
+            plan_mode = FFT_ESTIMATE;
+        } else if(strcmp(argv[i], "--no-window") == 0){
+            window = 0;
+        } else {
+            paths[num_paths++] = argv[i];
+        }
+    }
+
+    pgm_t ref;
+    real_t* reference = (num_paths > 1) ? read_real(paths[0], &ref) : NULL;
+    if(reference == NULL){
+        printf("Error opening file\n");
+        exit(1);
+    }
+
+    phasecorr_t* pc = phasecorr_create(reference, ref.width, ref.height, window, plan_mode);
+    free(reference);
+
+    char** names = paths + 1;
+    int num_frames = num_paths - 1;
+    real_t* frames[FRAME_CHUNK];
+    phasecorr_shift_t shifts[FRAME_CHUNK];
+
+    // The frames are read and registered in chunks, so the memory does not
+    // depend on the number of frames
+    for(int first = 0; first < num_frames; first += FRAME_CHUNK){
+        int count = (num_frames - first < FRAME_CHUNK) ? num_frames - first : FRAME_CHUNK;
+        int failed = 0;
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic) reduction(|:failed)
+#endif
+        for(int k = 0; k < count; k++){
+            pgm_t img;
+            frames[k] = read_real(names[first + k], &img);
+            if(frames[k] != NULL && (img.width != ref.width || img.height != ref.height)){
+                free(frames[k]);
+                frames[k] = NULL;
+            }
+            failed |= (frames[k] == NULL);
+        }
+
+        if(failed){
+            printf("Error opening file (as imagens devem ter o tamanho da referência)\n");
+            exit(1);
+        }
+
+        phasecorr_frames(pc, (const real_t* const*)frames, count, shifts);
+
+        for(int k = 0; k < count; k++){
+            printf("%s: dx %.3lf dy %.3lf peak %.3lf\n", names[first + k], shifts[k].dx, shifts[k].dy, shifts[k].peak);
+            free(frames[k]);
+        }
+    }
+
+    phasecorr_destroy(pc);
+    free(paths);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("Time: %.10lf\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    printf("Peak RSS: %ld KB\n", peak_rss_kb());
+    return 0;
+
+}
@@ -0,0 +1,109 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <complex.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "pgm.h"
+#include "fft_plan.h"
+#include "resize.h"
+
+// Function to get the peak memory of the process
+// return = peak resident set size in KB
+long peak_rss_kb(void){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Function to convert the resized image to 8-bit pixels
+// The ringing of the spectral method may leave the range, so the values are clamped
+// v = values
+// size = number of values
+// scale = factor of the values
+// max = maximum value of the output
+// pixels = output
+void to_pixels(const real_t* v, size_t size, double scale, int max, unsigned char* pixels){
+    for(size_t i = 0; i < size; i++){
+        double level = nearbyint(v[i] * scale);
+        pixels[i] = (level < 0) ? 0 : (level > max) ? max : (unsigned char)level;
+    }
+}
+
+
+int main(int argc, char** argv){
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(argc < 3){
+        printf("Uso: %s <imagem.pgm> <largura>x<altura> | <fator> [--estimate]\n", argv[0]);
+        return 1;
+    }
+
+    // Plan without measuring the kernels with --estimate
+    int plan_mode = FFT_MEASURE;
+    for(int i = 3; i < argc; i++){
+        if(strcmp(argv[i], "--estimate") == 0){
+            plan_mode = FFT_ESTIMATE;
+        }
+    }
+
+    FILE* fp = fopen(argv[1], "rb");
+    pgm_t img;
+    if(fp == NULL || pgm_read_header(fp, &img) != 0){
+        printf("Error opening file\n");
+        exit(1);
+    }
+
+    real_t* image = (real_t*)malloc((size_t)img.width * img.height * sizeof(real_t));
+    pgm_read_rows(fp, &img, image, img.height);
+    fclose(fp);
+
+    // New size as <width>x<height> or as a factor of the size
+    int new_width, new_height;
+    if(strchr(argv[2], 'x') != NULL){
+        if(sscanf(argv[2], "%dx%d", &new_width, &new_height) != 2){
+            new_width = new_height = 0;
+        }
+    } else {
+        double factor = atof(argv[2]);
+        new_width = (int)nearbyint(img.width * factor);
+        new_height = (int)nearbyint(img.height * factor);
+    }
+
+    if(new_width < 1 || new_height < 1){
+        printf("Tamanho inválido: %s\n", argv[2]);
+        exit(1);
+    }
+
+    real_t* resized = (real_t*)malloc((size_t)new_width * new_height * sizeof(real_t));
+    resize_spectral(image, img.width, img.height, resized, new_width, new_height, plan_mode);
+
+    // 16-bit images are written with 8 bits
+    double scale = 1;
+    int max = img.max;
+    if(max > 255){
+        scale = 255.0 / max;
+        max = 255;
+    }
+
+    size_t size = (size_t)new_width * new_height;
+    unsigned char* pixels = (unsigned char*)malloc(size);
+    to_pixels(resized, size, scale, max, pixels);
+    pgm_write_u8("results/resize.pgm", pixels, new_width, new_height, max);
+
+    free(image);
+    free(resized);
+    free(pixels);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printf("Size: %dx%d -> %dx%d\n", img.width, img.height, new_width, new_height);
+    printf("Time: %.10lf\n", (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    printf("Peak RSS: %ld KB\n", peak_rss_kb());
+    return 0;
+
+}
@@ -0,0 +1,630 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "pgm.h"
+#include "fft_plan.h"
+#include "filter.h"
+#include "frame.h"
+#include "service.h"
+
+// Biggest side of an image accepted by the server
+#define MAX_SIDE 65536
+
+// Memory of a job, by default, in MB: padded image, outputs and inline image
+#define MAX_MEMORY_MB 2048
+
+// Time a client has to send its request, in ms
+#define REQUEST_TIMEOUT_MS 1000
+
+// Time to read an image sent as a pipe or a socket, in ms
+#define SOURCE_TIMEOUT_MS 10000
+
+// Connections waiting for their request, at most
+#define PENDING_MAX 256
+
+// A connection waiting for its request or for a worker
+typedef struct job{
+    int sock;
+    int fd;                     // descriptor sent with the request, or -1
+    service_request_t req;
+    char *payload;              // image sent inline or through a pipe, or NULL
+    struct timespec accepted;
+    struct job *next;
+}job_t;
+
+// Warm state of a worker, kept between jobs
+typedef struct worker{
+    cplx *v;                    // padded image
+    size_t capacity;            // number of elements of v
+    filter_mask_t *mask;        // mask of the last filter
+    filter_spec_t mask_spec;
+}worker_t;
+
+// Queue of jobs and statistics, under lock
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ready = PTHREAD_COND_INITIALIZER;
+static job_t *head = NULL, *tail = NULL;
+static int queue_depth = 0;
+static int busy = 0;
+static int threads = 0;
+static uint64_t jobs = 0;
+static uint64_t errors = 0;
+static double window[SERVICE_WINDOW];     // latencies of the last jobs, in ms
+static uint64_t window_next = 0;
+static struct timespec started;
+
+// Plans shared by the workers, one per power of 2, under plans_lock
+static fft_plan_t *plans[32];
+static pthread_mutex_t plans_lock = PTHREAD_MUTEX_INITIALIZER;
+static int plan_mode = FFT_MEASURE;
+static size_t max_memory = (size_t)MAX_MEMORY_MB << 20;
+
+static volatile sig_atomic_t stop = 0;
+
+static void _on_signal(int sig){
+    (void)sig;
+    stop = 1;
+}
+
+static double _between_ms(const struct timespec *start, const struct timespec *end){
+    return (end->tv_sec - start->tv_sec) * 1e3 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static double _elapsed_ms(const struct timespec *start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return _between_ms(start, &now);
+}
+
+// Function to get the plan of a size, created the first time it is needed
+// n = size, a power of 2
+// return = plan, shared with the other workers
+static const fft_plan_t* _plan_for(int n){
+    int log2n = 0;
+    while((1 << log2n) < n){
+        log2n++;
+    }
+
+    pthread_mutex_lock(&plans_lock);
+    if(plans[log2n] == NULL){
+        plans[log2n] = fft_plan_create(n, plan_mode);
+    }
+    const fft_plan_t *plan = plans[log2n];
+    pthread_mutex_unlock(&plans_lock);
+
+    return plan;
+}
+
+// Function to read a pipe or a socket until its end
+// The image is bounded by the memory of a job and must arrive within
+// SOURCE_TIMEOUT_MS, so a writer that never closes its end does not hold
+// the worker forever
+// fd = descriptor
+// data = output, the bytes read (to be freed even on error)
+// length = output, number of bytes read
+// return = 0 on success, -1 on error
+static int _read_stream(int fd, char **data, size_t *length){
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    size_t capacity = 1 << 16, len = 0;
+    char *buf = (char*)malloc(capacity);
+    *data = buf;
+    *length = 0;
+
+    while(buf != NULL){
+        int left = SOURCE_TIMEOUT_MS - (int)_elapsed_ms(&start);
+        struct pollfd p = {fd, POLLIN, 0};
+        int ready = (left > 0) ? poll(&p, 1, left) : 0;
+        if(ready < 0 && errno == EINTR) continue;
+        if(ready <= 0) return -1;
+
+        if(len == capacity){
+            if(capacity >= max_memory) return -1;
+            capacity = (2 * capacity < max_memory) ? 2 * capacity : max_memory;
+            buf = (char*)realloc(buf, capacity);
+            if(buf == NULL) return -1;
+            *data = buf;
+        }
+
+        ssize_t r = read(fd, buf + len, capacity - len);
+        if(r < 0 && errno == EINTR) continue;
+        if(r < 0) return -1;
+        if(r == 0){
+            *length = len;
+            return 0;
+        }
+        len += r;
+    }
+    return -1;
+}
+
+// Function to open the image of a job
+// job = job, its descriptor is taken by the returned file
+// length = output, number of bytes of the image, -1 if it is not known
+// return = file positioned at the start of the image, NULL on error
+static FILE* _open_source(job_t *job, long long *length){
+    FILE *fp = NULL;
+    *length = -1;
+
+    if(job->req.source == SERVICE_SRC_PATH){
+        if(job->req.length == 0 || job->req.length > 4096){
+            return NULL;
+        }
+
+        char *path = (char*)malloc(job->req.length + 1);
+        if(path == NULL || service_read(job->sock, path, job->req.length) != 0){
+            free(path);
+            return NULL;
+        }
+        path[job->req.length] = '\0';
+
+        fp = fopen(path, "rb");
+        free(path);
+    } else if(job->req.source == SERVICE_SRC_FD && job->fd >= 0){
+        // Pipes and sockets have no size: they are read whole first
+        struct stat st;
+        if(fstat(job->fd, &st) != 0){
+            return NULL;
+        }
+        if(!S_ISREG(st.st_mode)){
+            size_t len;
+            if(_read_stream(job->fd, &job->payload, &len) != 0 || len == 0){
+                return NULL;
+            }
+            *length = len;
+            return fmemopen(job->payload, len, "rb");
+        }
+
+        fp = fdopen(job->fd, "rb");
+        if(fp != NULL){
+            job->fd = -1;
+            rewind(fp);
+        }
+    } else if(job->req.source == SERVICE_SRC_INLINE){
+        // The whole image is read first, so its length is known and bounded
+        // by the memory of a job
+        if(job->req.length == 0 || job->req.length > max_memory){
+            return NULL;
+        }
+
+        job->payload = (char*)malloc(job->req.length);
+        if(job->payload == NULL || service_read(job->sock, job->payload, job->req.length) != 0){
+            return NULL;
+        }
+
+        *length = job->req.length;
+        return fmemopen(job->payload, job->req.length, "rb");
+    }
+
+    // Files on disk have a known size
+    struct stat st;
+    if(fp != NULL && fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode)){
+        *length = st.st_size;
+    }
+    return fp;
+}
+
+// Function to end a job that failed
+// fp = image of the job, or NULL
+// reply = output, status set to status
+// status = reason of the failure
+// return = -1
+static int _fail(FILE *fp, service_reply_t *reply, int status){
+    if(fp != NULL) fclose(fp);
+    reply->status = status;
+    return -1;
+}
+
+// Function to tell if two filters are the same, field by field
+// a, b = filters
+// return = 1 if they are the same, 0 otherwise
+static int _same_spec(const filter_spec_t *a, const filter_spec_t *b){
+    return a->type == b->type && a->low == b->low && a->high == b->high;
+}
+
+// Function to run a job and put its outputs in a memfd
+// w = worker
+// job = job
+// reply = output, filled except for the times
+// return = memfd with the outputs, -1 on error (the status of reply says why)
+static int _run_job(worker_t *w, job_t *job, service_reply_t *reply){
+    const service_request_t *req = &job->req;
+
+    if(req->outputs == 0 || req->outputs >= (1 << SERVICE_OUTPUTS) ||
+       req->filter_type < FILTER_HIGHPASS || req->filter_type > FILTER_BANDPASS){
+        return _fail(NULL, reply, SERVICE_ERR_REQUEST);
+    }
+
+    long long length;
+    FILE *fp = _open_source(job, &length);
+    pgm_t img;
+    if(fp == NULL || pgm_read_header(fp, &img) != 0 ||
+       img.width <= 0 || img.height <= 0 || img.width > MAX_SIDE || img.height > MAX_SIDE){
+        return _fail(fp, reply, SERVICE_ERR_IMAGE);
+    }
+
+    // The pixels must fit in what is left of the image: at least one byte
+    // per pixel of a P2 image, one or two bytes per pixel of a P5 image
+    long long pixel_bytes = (long long)img.width * img.height * ((img.type[1] == '5' && img.max >= 256) ? 2 : 1);
+    if(length >= 0 && length - ftell(fp) < pixel_bytes){
+        return _fail(fp, reply, SERVICE_ERR_IMAGE);
+    }
+
+    int n = 1;
+    while(n < img.width || n < img.height){
+        n *= 2;
+    }
+
+    // Outputs one after the other in the memfd, written in place by frame_filter
+    size_t size = (size_t)n * n;
+    uint64_t sizes[SERVICE_OUTPUTS] = {(uint64_t)img.width * img.height, size, size};
+    uint64_t total = 0;
+    for(int k = 0; k < SERVICE_OUTPUTS; k++){
+        reply->offset[k] = total;
+        reply->size[k] = (req->outputs & (1 << k)) ? sizes[k] : 0;
+        total += reply->size[k];
+    }
+
+    // A header may ask for far more memory than the image has, e.g. a few
+    // bytes saying 60000 x 60000: jobs over the budget are refused
+    uint64_t memory = (uint64_t)size * sizeof(cplx) + total + ((job->payload != NULL) ? (uint64_t)length : 0);
+    if(memory > max_memory){
+        return _fail(fp, reply, SERVICE_ERR_IMAGE);
+    }
+
+    if(size > w->capacity){
+        free(w->v);
+        w->v = (cplx*)malloc(size * sizeof(cplx));
+        w->capacity = (w->v != NULL) ? size : 0;
+        if(w->v == NULL){
+            return _fail(fp, reply, SERVICE_ERR_IMAGE);
+        }
+    }
+
+    // The buffer still holds the previous image: clear the padding
+    for(int i = 0; i < img.height; i++){
+        memset(w->v + (size_t)i * n + img.width, 0, (n - img.width) * sizeof(cplx));
+    }
+    memset(w->v + (size_t)img.height * n, 0, (size_t)(n - img.height) * n * sizeof(cplx));
+
+    pgm_read_data(fp, &img, w->v, n);
+    fclose(fp);
+    free(job->payload);
+    job->payload = NULL;
+
+    const fft_plan_t *plan = _plan_for(n);
+
+    filter_spec_t spec = {req->filter_type, req->filter_low, req->filter_high};
+    if(w->mask == NULL || w->mask->width != n || !_same_spec(&spec, &w->mask_spec)){
+        if(w->mask != NULL) filter_mask_destroy(w->mask);
+        w->mask = filter_mask_create(n, n, &spec);
+        w->mask_spec = spec;
+    }
+
+    int mfd = memfd_create("fft_job", MFD_CLOEXEC);
+    if(mfd < 0 || ftruncate(mfd, total) != 0){
+        if(mfd >= 0) close(mfd);
+        return _fail(NULL, reply, SERVICE_ERR_IMAGE);
+    }
+    unsigned char *out = (unsigned char*)mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, mfd, 0);
+    if(out == MAP_FAILED){
+        close(mfd);
+        return _fail(NULL, reply, SERVICE_ERR_IMAGE);
+    }
+
+    unsigned char *at[SERVICE_OUTPUTS];
+    for(int k = 0; k < SERVICE_OUTPUTS; k++){
+        at[k] = (reply->size[k] > 0) ? out + reply->offset[k] : NULL;
+    }
+
+    reply->max = frame_filter(w->v, n, img.width, img.height, img.max, plan, w->mask, at[1], at[2], at[0]);
+    munmap(out, total);
+
+    reply->status = SERVICE_OK;
+    reply->width = img.width;
+    reply->height = img.height;
+    reply->n = n;
+    return mfd;
+}
+
+static int _compare_double(const void *a, const void *b){
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Function to fill the statistics of the server
+// stats = output
+static void _stats(service_stats_t *stats){
+    double sorted[SERVICE_WINDOW];
+
+    memset(stats, 0, sizeof(*stats));
+    stats->magic = SERVICE_MAGIC;
+    stats->status = SERVICE_OK;
+
+    pthread_mutex_lock(&lock);
+    stats->threads = threads;
+    stats->busy = busy;
+    stats->queue_depth = queue_depth;
+    stats->jobs = jobs;
+    stats->errors = errors;
+    int count = (window_next < SERVICE_WINDOW) ? (int)window_next : SERVICE_WINDOW;
+    memcpy(sorted, window, count * sizeof(double));
+    pthread_mutex_unlock(&lock);
+
+    stats->uptime_s = _elapsed_ms(&started) / 1e3;
+
+    if(count > 0){
+        qsort(sorted, count, sizeof(double), _compare_double);
+        stats->p50_ms = sorted[(count - 1) * 50 / 100];
+        stats->p90_ms = sorted[(count - 1) * 90 / 100];
+        stats->p99_ms = sorted[(count - 1) * 99 / 100];
+        stats->max_ms = sorted[count - 1];
+    }
+}
+
+// Function to close the connection of a job and free it
+// job = job
+static void _drop(job_t *job){
+    if(job->fd >= 0) close(job->fd);
+    close(job->sock);
+    free(job->payload);
+    free(job);
+}
+
+// Function to run the jobs of the queue, forever
+static void* _worker(void *arg){
+    (void)arg;
+    worker_t w;
+    memset(&w, 0, sizeof(w));
+
+    for(;;){
+        pthread_mutex_lock(&lock);
+        while(head == NULL){
+            pthread_cond_wait(&ready, &lock);
+        }
+        job_t *job = head;
+        head = job->next;
+        if(head == NULL) tail = NULL;
+        queue_depth--;
+        busy++;
+        pthread_mutex_unlock(&lock);
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        service_reply_t reply;
+        memset(&reply, 0, sizeof(reply));
+        reply.magic = SERVICE_MAGIC;
+        reply.queue_ms = _between_ms(&job->accepted, &start);
+
+        int mfd = _run_job(&w, job, &reply);
+        reply.run_ms = _elapsed_ms(&start);
+
+        service_send(job->sock, &reply, sizeof(reply), mfd);
+        if(mfd >= 0) close(mfd);
+
+        double latency = _elapsed_ms(&job->accepted);
+        _drop(job);
+
+        pthread_mutex_lock(&lock);
+        busy--;
+        if(reply.status == SERVICE_OK){
+            jobs++;
+            window[window_next++ % SERVICE_WINDOW] = latency;
+        } else {
+            errors++;
+        }
+        pthread_mutex_unlock(&lock);
+    }
+
+    return NULL;
+}
+
+// Function to take the request of a connection once all of it has arrived
+// The acceptor calls it and it never blocks: the request is peeked first and
+// read only when it is complete. The statistics are answered at once, so they
+// never wait behind the jobs, and the jobs go to the queue of the workers
+// job = connection
+// return = 1 if the connection was answered, queued or dropped, 0 to keep waiting
+static int _take_request(job_t *job){
+    service_request_t req;
+    ssize_t got = recv(job->sock, &req, sizeof(req), MSG_PEEK | MSG_DONTWAIT);
+    if(got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+        return 0;
+    }
+    if(got > 0 && got < (ssize_t)sizeof(req)){
+        return 0;
+    }
+
+    if(got <= 0 || service_recv(job->sock, &job->req, sizeof(job->req), &job->fd) != 0 || job->req.magic != SERVICE_MAGIC){
+        _drop(job);
+        return 1;
+    }
+
+    if(job->req.kind == SERVICE_STATS){
+        service_stats_t stats;
+        _stats(&stats);
+        service_send(job->sock, &stats, sizeof(stats), -1);
+        _drop(job);
+        return 1;
+    }
+
+    // The worker reads the rest (path or inline image), with a timeout
+    struct timeval timeout = {REQUEST_TIMEOUT_MS / 1000, 0};
+    setsockopt(job->sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    pthread_mutex_lock(&lock);
+    if(tail != NULL){
+        tail->next = job;
+    } else {
+        head = job;
+    }
+    tail = job;
+    queue_depth++;
+    pthread_cond_signal(&ready);
+    pthread_mutex_unlock(&lock);
+    return 1;
+}
+
+int main(int argc, char** argv){
+
+    if(argc < 2){
+        printf("Uso: %s <socket> [--threads <n>] [--max-memory <MB>] [--estimate]\n", argv[0]);
+        return 1;
+    }
+
+    // Number of workers with --threads <n>, one per core by default
+    // Memory of a job, in MB, with --max-memory <MB>
+    // Plan without measuring the kernels with --estimate
+    threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    for(int i = 2; i < argc; i++){
+        if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+            threads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--max-memory") == 0 && i + 1 < argc){
+            long mb = atol(argv[++i]);
+            if(mb < 1){
+                printf("Memória inválida: %s\n", argv[i]);
+                return 1;
+            }
+            max_memory = (size_t)mb << 20;
+        } else if(strcmp(argv[i], "--estimate") == 0){
+            plan_mode = FFT_ESTIMATE;
+        }
+    }
+    if(threads < 1) threads = 1;
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(argv[1]) >= sizeof(addr.sun_path)){
+        printf("Caminho do socket muito longo: %s\n", argv[1]);
+        return 1;
+    }
+    strcpy(addr.sun_path, argv[1]);
+
+    // Only the socket of a previous run is removed, never another file
+    struct stat st;
+    if(lstat(argv[1], &st) == 0){
+        if(!S_ISSOCK(st.st_mode)){
+            printf("%s já existe e não é um socket\n", argv[1]);
+            return 1;
+        }
+        unlink(argv[1]);
+    }
+
+    // The server opens the paths it is sent, so only its own user may connect
+    mode_t mask = umask(077);
+    int bound = listener >= 0 && bind(listener, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+    umask(mask);
+
+    if(!bound || listen(listener, 128) != 0){
+        printf("Error opening socket %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    // poll returns on SIGINT and SIGTERM, and a client that goes away does
+    // not kill the server
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = _on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    for(int k = 0; k < threads; k++){
+        pthread_t worker;
+        pthread_create(&worker, NULL, _worker, NULL);
+        pthread_detach(worker);
+    }
+
+    printf("Listening on %s with %d threads\n", argv[1], threads);
+    fflush(stdout);
+
+    // Connections whose request has not arrived yet
+    job_t *pending[PENDING_MAX];
+    struct pollfd fds[PENDING_MAX + 1];
+    int num_pending = 0;
+
+    while(!stop){
+        // New connections are accepted while there is room for them
+        fds[0].fd = (num_pending < PENDING_MAX) ? listener : -1;
+        fds[0].events = POLLIN;
+
+        // Wait until a request arrives or the first one is late
+        int timeout = -1;
+        for(int k = 0; k < num_pending; k++){
+            fds[k + 1].fd = pending[k]->sock;
+            fds[k + 1].events = POLLIN;
+
+            int left = REQUEST_TIMEOUT_MS - (int)_elapsed_ms(&pending[k]->accepted);
+            if(left < 0) left = 0;
+            if(timeout < 0 || left < timeout) timeout = left;
+        }
+
+        // poll returns on SIGINT and SIGTERM
+        if(poll(fds, num_pending + 1, timeout) < 0){
+            continue;
+        }
+
+        // From the last one, so the connections moved into a free place were already seen
+        for(int k = num_pending - 1; k >= 0; k--){
+            int done = (fds[k + 1].revents != 0) ? _take_request(pending[k]) : 0;
+
+            // A client that does not send its request in time is dropped
+            if(!done && _elapsed_ms(&pending[k]->accepted) >= REQUEST_TIMEOUT_MS){
+                _drop(pending[k]);
+                done = 1;
+            }
+            if(done){
+                pending[k] = pending[--num_pending];
+            }
+        }
+
+        if(fds[0].revents & POLLIN){
+            int sock = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+            if(sock < 0){
+                continue;
+            }
+
+            job_t *job = (job_t*)malloc(sizeof(job_t));
+            if(job == NULL){
+                close(sock);
+                continue;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &job->accepted);
+            job->sock = sock;
+            job->fd = -1;
+            job->payload = NULL;
+            job->next = NULL;
+            pending[num_pending++] = job;
+        }
+    }
+
+    for(int k = 0; k < num_pending; k++){
+        _drop(pending[k]);
+    }
+    close(listener);
+    unlink(argv[1]);
+
+    service_stats_t stats;
+    _stats(&stats);
+    printf("Jobs: %llu (%llu errors)\n", (unsigned long long)stats.jobs, (unsigned long long)stats.errors);
+    printf("Latency: %.3lf ms (p50), %.3lf ms (p99)\n", stats.p50_ms, stats.p99_ms);
+    return 0;
+
+}
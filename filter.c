@@ -0,0 +1,246 @@
+#include "filter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// Function to keep a ring of frequencies of rows of an unshifted spectrum
+// The frequencies are moved to the center the same way fftshift does, so the
+// rows can belong to a slab of a bigger spectrum
+// v = rows of the spectrum
+// width = number of columns of the spectrum
+// height = number of rows of the whole spectrum
+// first_row = global index of the first row in v
+// num_rows = number of rows in v
+// r_low, r_high = the elements at a distance d from the center with
+// r_low <= d < r_high are kept, the others are set to zero
+static void _ring_filter(cplx* v, int width, int height, int first_row, int num_rows, double r_low, double r_high){
+    int cx = width / 2;
+    int cy = height / 2;
+
+    for(int i = 0; i < num_rows; i++){
+        // Row of the shifted spectrum
+        int y = (first_row + i + height / 2) % height;
+
+        for(int j = 0; j < width; j++){
+            int x = (j + width / 2) % width;
+
+            double dist = sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy));
+
+            if(dist < r_low || dist >= r_high){
+                v[i * width + j] = 0;
+            }
+        }
+    }
+}
+
+// Function to apply the high-pass filter to rows of an unshifted spectrum
+// v, width, height, first_row, num_rows = see _ring_filter
+// cutoff = radius around the center that is set to zero
+void highpass_filter(cplx* v, int width, int height, int first_row, int num_rows, double cutoff){
+    _ring_filter(v, width, height, first_row, num_rows, cutoff, HUGE_VAL);
+}
+
+// Function to get the ring of frequencies kept by a filter spec
+// spec = filter, with radii relative to the width
+// width = number of columns of the spectrum
+// r_low, r_high = output, see _ring_filter
+static void _spec_radii(const filter_spec_t* spec, int width, double* r_low, double* r_high){
+    double low = spec->low * width;
+    double high = spec->high * width;
+
+    if(spec->type == FILTER_HIGHPASS){
+        *r_low = low;
+        *r_high = HUGE_VAL;
+    } else if(spec->type == FILTER_LOWPASS){
+        *r_low = 0;
+        *r_high = low;
+    } else {
+        *r_low = low;
+        *r_high = high;
+    }
+}
+
+// Function to apply a filter spec to rows of an unshifted spectrum
+// v, width, height, first_row, num_rows = see _ring_filter
+// spec = filter, with radii relative to the width
+void filter_apply(cplx* v, int width, int height, int first_row, int num_rows, const filter_spec_t* spec){
+    double r_low, r_high;
+    _spec_radii(spec, width, &r_low, &r_high);
+    _ring_filter(v, width, height, first_row, num_rows, r_low, r_high);
+}
+
+// Function to apply a filter spec to rows of the slices of an unshifted 3D spectrum
+// The distance is taken in frequencies relative to the size of each axis, so
+// the depth is scaled to the width and the filter is a sphere in frequency
+// v = rows of every slice, element (z, i, j) at v[(z * num_rows + i) * width + j]
+// width = number of columns of the spectrum
+// height = number of rows of each whole slice
+// depth = number of slices
+// first_row = global index of the first row in v
+// num_rows = number of rows of each slice in v
+// spec = filter, with radii relative to the width
+void filter_apply_3d(cplx* v, int width, int height, int depth, int first_row, int num_rows, const filter_spec_t* spec){
+    double r_low, r_high;
+    _spec_radii(spec, width, &r_low, &r_high);
+
+    double z_scale = (double)width / depth;
+
+#ifdef _OPENMP
+    #pragma omp parallel for collapse(2)
+#endif
+    for(int k = 0; k < depth; k++){
+        for(int i = 0; i < num_rows; i++){
+            // Signed frequencies of the slice and of the row
+            double z = ((k + depth / 2) % depth - depth / 2) * z_scale;
+            int y = (first_row + i + height / 2) % height - height / 2;
+            cplx* row = v + ((size_t)k * num_rows + i) * width;
+
+            for(int j = 0; j < width; j++){
+                int x = (j + width / 2) % width - width / 2;
+                double dist = sqrt(x * x + y * y + z * z);
+
+                if(dist < r_low || dist >= r_high){
+                    row[j] = 0;
+                }
+            }
+        }
+    }
+}
+
+// Function to compute the mask of a filter spec for a size of spectrum
+// The columns that _ring_filter sets to zero are stored as runs per row, so
+// spectra of the same size are filtered without computing any distance
+// width, height = size of the unshifted spectrum
+// spec = filter, with radii relative to the width
+// return = mask
+filter_mask_t* filter_mask_create(int width, int height, const filter_spec_t* spec){
+    double r_low, r_high;
+    _spec_radii(spec, width, &r_low, &r_high);
+
+    int cx = width / 2;
+    int cy = height / 2;
+
+    filter_mask_t* mask = (filter_mask_t*)malloc(sizeof(filter_mask_t));
+    mask->width = width;
+    mask->height = height;
+    mask->row_start = (int*)malloc((height + 1) * sizeof(int));
+
+    int capacity = 2 * height;
+    int count = 0;
+    mask->runs = (int*)malloc(capacity * sizeof(int));
+
+    for(int i = 0; i < height; i++){
+        mask->row_start[i] = count;
+        int y = (i + height / 2) % height;
+
+        for(int j = 0; j < width; j++){
+            int x = (j + width / 2) % width;
+            double dist = sqrt((x - cx) * (x - cx) + (y - cy) * (y - cy));
+            if(dist >= r_low && dist < r_high) continue;
+
+            // Extend the last run of the row or start a new one
+            if(count > mask->row_start[i] && mask->runs[count - 1] == j){
+                mask->runs[count - 1] = j + 1;
+            } else {
+                if(count + 2 > capacity){
+                    capacity *= 2;
+                    mask->runs = (int*)realloc(mask->runs, capacity * sizeof(int));
+                }
+                mask->runs[count++] = j;
+                mask->runs[count++] = j + 1;
+            }
+        }
+    }
+    mask->row_start[height] = count;
+
+    return mask;
+}
+
+// Function to apply a mask to rows of an unshifted spectrum
+// mask = mask of the size of the spectrum
+// v = rows of the spectrum
+// first_row = global index of the first row in v
+// num_rows = number of rows in v
+void filter_mask_apply(const filter_mask_t* mask, cplx* v, int first_row, int num_rows){
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i = 0; i < num_rows; i++){
+        cplx* row = v + (size_t)i * mask->width;
+        int global = first_row + i;
+
+        for(int k = mask->row_start[global]; k < mask->row_start[global + 1]; k += 2){
+            memset(row + mask->runs[k], 0, (mask->runs[k + 1] - mask->runs[k]) * sizeof(cplx));
+        }
+    }
+}
+
+// Function to apply a mask to a batch of interleaved unshifted spectra
+// mask = mask of the size of the spectra
+// v = count spectra, element (y, x) of spectrum b at v[(y * width + x) * count + b]
+// count = number of spectra
+void filter_mask_apply_batch(const filter_mask_t* mask, cplx* v, int count){
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i = 0; i < mask->height; i++){
+        cplx* row = v + (size_t)i * mask->width * count;
+
+        // A run of columns is a run of whole elements of the batch
+        for(int k = mask->row_start[i]; k < mask->row_start[i + 1]; k += 2){
+            memset(row + (size_t)mask->runs[k] * count, 0, (size_t)(mask->runs[k + 1] - mask->runs[k]) * count * sizeof(cplx));
+        }
+    }
+}
+
+// Function to free a mask
+// mask = mask
+void filter_mask_destroy(filter_mask_t* mask){
+    free(mask->row_start);
+    free(mask->runs);
+    free(mask);
+}
+
+// Function to parse a comma-separated list of filters, e.g. hp:0.1,lp:0.2,bp:0.05:0.3
+// list = text of the list
+// specs = output, array allocated with one spec per filter
+// return = number of filters, -1 if the list is invalid
+int filter_parse_specs(const char* list, filter_spec_t** specs){
+    int count = 1;
+    for(const char* c = list; *c != '\0'; c++){
+        if(*c == ',') count++;
+    }
+
+    *specs = (filter_spec_t*)malloc(count * sizeof(filter_spec_t));
+
+    const char* item = list;
+    for(int k = 0; k < count; k++){
+        filter_spec_t* f = &(*specs)[k];
+        char text[64], extra;
+
+        size_t len = strcspn(item, ",");
+        if(len >= sizeof(text)){
+            free(*specs);
+            return -1;
+        }
+        memcpy(text, item, len);
+        text[len] = '\0';
+
+        f->high = 0;
+        if(sscanf(text, "hp:%lf%c", &f->low, &extra) == 1){
+            f->type = FILTER_HIGHPASS;
+        } else if(sscanf(text, "lp:%lf%c", &f->low, &extra) == 1){
+            f->type = FILTER_LOWPASS;
+        } else if(sscanf(text, "bp:%lf:%lf%c", &f->low, &f->high, &extra) == 2){
+            f->type = FILTER_BANDPASS;
+        } else {
+            free(*specs);
+            return -1;
+        }
+
+        item += len + 1;
+    }
+
+    return count;
+}
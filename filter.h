@@ -0,0 +1,43 @@
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include "pgm.h"
+
+// Types of filter_spec_t
+#define FILTER_HIGHPASS 0
+#define FILTER_LOWPASS 1
+#define FILTER_BANDPASS 2
+
+// A filter given on the command line: hp:<r>, lp:<r> or bp:<r1>:<r2>
+// The radii are fractions of the width of the spectrum
+typedef struct filter_spec{
+    int type;
+    double low;     // radius of hp and lp, inner radius of bp
+    double high;    // outer radius of bp
+}filter_spec_t;
+
+// Zero runs of a filter for one size of spectrum, see filter_mask_create
+typedef struct filter_mask{
+    int width;
+    int height;
+    int *row_start;     // the runs of row i are at runs[row_start[i]] to runs[row_start[i + 1] - 1]
+    int *runs;          // first and end column of each run of zeros
+}filter_mask_t;
+
+void highpass_filter(cplx*, int, int, int, int, double);
+
+void filter_apply(cplx*, int, int, int, int, const filter_spec_t*);
+
+void filter_apply_3d(cplx*, int, int, int, int, int, const filter_spec_t*);
+
+int filter_parse_specs(const char*, filter_spec_t**);
+
+filter_mask_t* filter_mask_create(int, int, const filter_spec_t*);
+
+void filter_mask_apply(const filter_mask_t*, cplx*, int, int);
+
+void filter_mask_apply_batch(const filter_mask_t*, cplx*, int);
+
+void filter_mask_destroy(filter_mask_t*);
+
+#endif
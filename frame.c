@@ -0,0 +1,100 @@
+#include "frame.h"
+#include "spectrum.h"
+
+// Function to convert a spectrum to log-scaled bytes, with the low
+// frequencies in the center as fftshift leaves them
+// v = n x n unshifted spectrum
+// n = number of rows and columns
+// out = n x n bytes
+static void _log_shifted(const cplx *v, int n, unsigned char *out){
+    double max_sq = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(max:max_sq)
+#endif
+    for(int i = 0; i < n; i++){
+        double row_max_sq = spectrum_max_sq(v + (size_t)i * n, n);
+        if(row_max_sq > max_sq){
+            max_sq = row_max_sq;
+        }
+    }
+
+    // Element x of row i goes to column (x + n / 2) % n of row (i + n / 2) % n
+    int half = n / 2;
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i = 0; i < n; i++){
+        const cplx *row = v + (size_t)i * n;
+        unsigned char *dst = out + (size_t)((i + half) % n) * n;
+
+        spectrum_log_u8(row, n - half, max_sq, dst + half);
+        spectrum_log_u8(row + n - half, half, max_sq, dst);
+    }
+}
+
+// Function to filter an image with the FFT, as the file versions do
+// v = n x n buffer with the image in the top left corner and zeros around
+//     it, used as the work buffer
+// n = size of the padded image, a power of 2
+// width, height, max = size and maximum value of the image
+// plan, mask = plan and filter mask of size n
+// spectrum = NULL, or n x n bytes for the spectrum (fft.pgm)
+// filtered = NULL, or n x n bytes for the filtered spectrum (filtered_fft.pgm)
+// pixels = NULL, or width x height bytes for the filtered image (ifft.pgm)
+// return = maximum value of the filtered image
+int frame_filter(cplx *v, int n, int width, int height, int max, const fft_plan_t *plan, const filter_mask_t *mask, unsigned char *spectrum, unsigned char *filtered, unsigned char *pixels){
+    // Rows from height on are zero padding
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i = 0; i < height; i++){
+        fft_execute(plan, v + (size_t)i * n, 0);
+    }
+    fft_transpose_inplace(plan, v, n);
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i = 0; i < n; i++){
+        fft_execute(plan, v + (size_t)i * n, 0);
+    }
+
+    if(spectrum != NULL){
+        _log_shifted(v, n, spectrum);
+    }
+
+    filter_mask_apply(mask, v, 0, n);
+
+    if(filtered != NULL){
+        _log_shifted(v, n, filtered);
+    }
+
+    // 16-bit images are written with 8 bits
+    double scale = 1.0 / ((double)n * n);
+    if(max > 255){
+        scale *= 255.0 / max;
+        max = 255;
+    }
+
+    if(pixels == NULL){
+        return max;
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i = 0; i < n; i++){
+        fft_execute(plan, v + (size_t)i * n, 1);
+    }
+    fft_transpose_inplace(plan, v, n);
+
+    // Last pass: normalize, crop and convert to pixels
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i = 0; i < height; i++){
+        fft_execute(plan, v + (size_t)i * n, 1);
+        spectrum_abs_u8(v + (size_t)i * n, width, scale, pixels + (size_t)i * width);
+    }
+
+    return max;
+}
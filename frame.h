@@ -0,0 +1,9 @@
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include "fft_plan.h"
+#include "filter.h"
+
+int frame_filter(cplx *, int, int, int, int, const fft_plan_t *, const filter_mask_t *, unsigned char *, unsigned char *, unsigned char *);
+
+#endif
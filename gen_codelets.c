@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#define PI 3.14159265358979323846
+
+// Gerador dos codelets: kernels de FFT sem lacos, com os fatores de rotacao
+// constantes, para os tamanhos 8, 16, 32 e 64. Rode como um passo da compilacao:
+//   gcc -o gen_codelets gen_codelets.c -lm && ./gen_codelets > codelets.c
+
+// Function to emit one codelet
+// Each codelet performs all the radix-2 stages of a transform of size n whose
+// input is already in bit-reversed order, as in cooley_tukey_fft
+// n = size of the codelet
+// inverse = emit the inverse transform (conjugated twiddles)
+void emit_codelet(int n, int inverse){
+    double sign = (inverse) ? 1.0 : -1.0;
+
+    printf("static void codelet_%d_%s(cplx* x){\n", n, (inverse) ? "inv" : "fwd");
+    printf("    real_t* d = (real_t*)x;\n");
+
+    for(int i = 0; i < n; i++){
+        printf("    real_t x%dr = d[%d], x%di = d[%d];\n", i, 2 * i, i, 2 * i + 1);
+    }
+    printf("    real_t tr, ti;\n");
+
+    for(int m = 2; m <= n; m *= 2){
+        printf("    // Stage with subproblem size %d\n", m);
+
+        for(int k = 0; k < n; k += m){
+            for(int j = 0; j < m / 2; j++){
+                int a = k + j;
+                int b = k + j + m / 2;
+
+                if(j == 0){
+                    // omega = 1
+                    printf("    tr = x%dr; ti = x%di;\n", b, b);
+                } else if(4 * j == m){
+                    // omega = -i (forward) or i (inverse)
+                    if(inverse){
+                        printf("    tr = -x%di; ti = x%dr;\n", b, b);
+                    } else {
+                        printf("    tr = x%di; ti = -x%dr;\n", b, b);
+                    }
+                } else {
+                    double c = cos(sign * 2.0 * PI * j / m);
+                    double s = sin(sign * 2.0 * PI * j / m);
+                    printf("    tr = x%dr * (real_t)%.20e - x%di * (real_t)%.20e;\n", b, c, b, s);
+                    printf("    ti = x%dr * (real_t)%.20e + x%di * (real_t)%.20e;\n", b, s, b, c);
+                }
+
+                printf("    x%dr = x%dr - tr; x%di = x%di - ti;\n", b, a, b, a);
+                printf("    x%dr = x%dr + tr; x%di = x%di + ti;\n", a, a, a, a);
+            }
+        }
+    }
+
+    for(int i = 0; i < n; i++){
+        printf("    d[%d] = x%dr; d[%d] = x%di;\n", 2 * i, i, 2 * i + 1, i);
+    }
+    printf("}\n\n");
+}
+
+int main(void){
+    int sizes[] = {8, 16, 32, 64};
+    int num_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+    printf("// Arquivo gerado por gen_codelets.c, nao edite\n\n");
+    printf("#include \"codelets.h\"\n\n");
+
+    for(int i = 0; i < num_sizes; i++){
+        emit_codelet(sizes[i], 0);
+        emit_codelet(sizes[i], 1);
+    }
+
+    printf("const codelet_t fft_codelets[] = {\n");
+    for(int i = 0; i < num_sizes; i++){
+        printf("    {%d, codelet_%d_fwd, codelet_%d_inv},\n", sizes[i], sizes[i], sizes[i]);
+    }
+    printf("};\n\n");
+    printf("const int fft_num_codelets = %d;\n", num_sizes);
+
+    return 0;
+}
@@ -1,23 +1,85 @@
 #include "pgm.h"
+#include "spectrum.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <complex.h>
 #include <math.h>
 
-typedef double complex cplx;
+// Function to create a text image and write its header
+// filename = path of the image
+// width, height, max = header of the image
+// return = file positioned at the pixel data
+FILE *pgm_create_u8(char *filename, int width, int height, int max){
 
-pgm_t log_scale(pgm_t img){
+    FILE *fp = fopen(filename, "wb");
 
-    double c = 255/log(1 + img.max);
+    if(fp == NULL){
+        printf("Error opening file\n");
+        exit(1);
+    }
 
-    for(int i = 0; i < img.height; i++){
-        for(int j = 0; j < img.width; j++){
-            img.data[i][j] = c * log(1 + cabs(img.data[i][j]));
+    fprintf(fp, "P2\n%d %d\n%d\n", width, height, max);
+    return fp;
+}
+
+// Function to write rows of 8-bit pixels of a text image
+// fp = file created by pgm_create_u8, after the previous rows
+// pixels = rows rows of width pixels
+// width = number of columns
+// rows = number of rows
+void pgm_write_u8_rows(FILE *fp, const unsigned char *pixels, int width, int rows){
+
+    // "%d " of every byte
+    char digits[256][5];
+    int lengths[256];
+    for(int k = 0; k < 256; k++){
+        lengths[k] = sprintf(digits[k], "%d ", k);
+    }
+
+    char *line = (char*)malloc(4 * width + 2);
+
+    for(int i = 0; i < rows; i++){
+        const unsigned char *row = pixels + (size_t)i * width;
+        int len = 0;
+
+        for(int j = 0; j < width; j++){
+            memcpy(line + len, digits[row[j]], 4);
+            len += lengths[row[j]];
         }
+        line[len++] = '\n';
+
+        fwrite(line, 1, len, fp);
     }
 
-    return img;
+    free(line);
+}
+
+// Function to write an image of 8-bit pixels to an open stream
+// fp = stream, e.g. stdout, after the previous images
+// pixels, width, height, max = see pgm_write_u8
+// binary = 1 for a P5 image, 0 for a P2 image
+void pgm_write_frame(FILE *fp, const unsigned char *pixels, int width, int height, int max, int binary){
+    fprintf(fp, "%s\n%d %d\n%d\n", (binary) ? "P5" : "P2", width, height, max);
+
+    if(binary){
+        fwrite(pixels, 1, (size_t)width * height, fp);
+    } else {
+        pgm_write_u8_rows(fp, pixels, width, height);
+    }
+}
+
+// Function to write 8-bit pixels as a text image
+// filename = path of the image
+// pixels = height rows of width pixels
+// width = number of columns
+// height = number of rows
+// max = maximum value of the header
+void pgm_write_u8(char *filename, const unsigned char *pixels, int width, int height, int max){
+
+    FILE *fp = pgm_create_u8(filename, width, height, max);
+    pgm_write_u8_rows(fp, pixels, width, height);
+    fclose(fp);
 }
 
 void pgm_write(pgm_t img, char *fabs, char *farg){
@@ -104,98 +166,166 @@ void pgm_write(pgm_t img, char *fabs, char *farg){
 
 void pgm_write_fft(pgm_t img, char *fabs, char *farg){
 
+    // Log-scaled magnitudes, then only bytes are written
+    double img_max_sq = 0;
+#ifdef _OPENMP
+    #pragma omp parallel for reduction(max:img_max_sq)
+#endif
+    for(int i = 0; i < img.height; i++){
+        double row_max_sq = spectrum_max_sq(img.data[i], img.width);
+        if(row_max_sq > img_max_sq){
+            img_max_sq = row_max_sq;
+        }
+    }
+
+    unsigned char *pixels = (unsigned char*)malloc((size_t)img.width * img.height);
+
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(int i = 0; i < img.height; i++){
+        spectrum_log_u8(img.data[i], img.width, img_max_sq, pixels + (size_t)i * img.width);
+    }
+
+    pgm_write_u8(fabs, pixels, img.width, img.height, img.max);
+
+    free(pixels);
+
     if (strcmp(farg, "") != 0)
     {
-        FILE *fpabs;
         FILE *fparg;
 
-        fpabs = fopen(fabs, "wb");
         fparg = fopen(farg, "wb");
 
-        if (fpabs == NULL || fparg == NULL)
+        if (fparg == NULL)
         {
             printf("Error opening file\n");
             exit(1);
         }
 
-        fprintf(fpabs, "%s\n", img.type);
         fprintf(fparg, "%s\n", img.type);
 
-        fprintf(fpabs, "%d %d\n", img.width, img.height);
         fprintf(fparg, "%d %d\n", img.width, img.height);
 
-        fprintf(fpabs, "%d\n", img.max);
         fprintf(fparg, "%d\n", img.max);
 
-        double img_max = 0;
         for(int i = 0; i < img.height; i++){
             for(int j = 0; j < img.width; j++){
-                if(cabs(img.data[i][j]) > img_max){
-                    img_max = cabs(img.data[i][j]);
-                }
-            }
-        }
-
-        double c = 255/log(1 + img_max);
-
-        for(int i = 0; i < img.height; i++){
-            for(int j = 0; j < img.width; j++){
-
-                double img_tmp = c * log(1 + cabs(img.data[i][j]));
-
-                fprintf(fpabs, "%0.lf ", img_tmp);
                 fprintf(fparg, "%0.lf ", carg(img.data[i][j]));
             }
-            fprintf(fpabs, "\n");
             fprintf(fparg, "\n");
         }
 
-        fclose(fpabs);
         fclose(fparg);
-    } else {
+    }
 
-        FILE *fpabs;
+} 
 
-        fpabs = fopen(fabs, "wb");
+// Function to skip whitespace and comments in a pgm header
+// fp = file positioned inside the header
+// return = next character that is not whitespace or part of a comment
+static int _skip_header_space(FILE *fp){
+    int c = fgetc(fp);
+    while(c != EOF){
+        if(c == '#'){
+            while(c != '\n' && c != EOF) c = fgetc(fp);
+        } else if(c != ' ' && c != '\t' && c != '\n' && c != '\r'){
+            break;
+        }
+        c = fgetc(fp);
+    }
+    return c;
+}
 
-        if(fpabs == NULL){
-            printf("Error opening file\n");
-            exit(1);
+// Function to read the header of a P2 or P5 image
+// fp = opened file, left positioned at the first byte of the pixel data
+// img = type, width, height and max are filled, data is set to NULL
+// return = 0 on success, -1 if the header is invalid
+int pgm_read_header(FILE *fp, pgm_t *img){
+    int c = _skip_header_space(fp);
+    if(c != 'P') return -1;
+
+    c = fgetc(fp);
+    if(c != '2' && c != '5') return -1;
+    img->type[0] = 'P';
+    img->type[1] = (char)c;
+    img->type[2] = '\0';
+
+    int *fields[3] = {&img->width, &img->height, &img->max};
+    for(int f = 0; f < 3; f++){
+        c = _skip_header_space(fp);
+        if(c == EOF || ungetc(c, fp) == EOF || fscanf(fp, "%d", fields[f]) != 1){
+            return -1;
         }
+    }
 
-        fprintf(fpabs, "%s\n", img.type);
+    // A single whitespace character separates the header from the data
+    fgetc(fp);
 
-        fprintf(fpabs, "%d %d\n", img.width, img.height);
+    img->data = NULL;
+    return 0;
+}
 
-        fprintf(fpabs, "%d\n", img.max);
+// Function to read the next pixel of an image
+// fp = file positioned at the pixel
+// img = header of the image
+// return = value of the pixel, 0 if it is missing
+static int _read_pixel(FILE *fp, const pgm_t *img){
+    int tmp;
 
-        double img_max = 0;
-        for(int i = 0; i < img.height; i++){
-            for(int j = 0; j < img.width; j++){
-                if(cabs(img.data[i][j]) > img_max){
-                    img_max = cabs(img.data[i][j]);
-                }
+    if(img->type[1] == '5'){
+        tmp = fgetc(fp);
+        if(img->max >= 256) tmp = (tmp << 8) | fgetc(fp);
+    } else if(fscanf(fp, "%d", &tmp) != 1){
+        tmp = 0;
+    }
+    return tmp;
+}
+
+// Function to read the pixels of an image into the rows of a bigger matrix
+// fp = file positioned at the pixel data (see pgm_read_header)
+// img = header of the image, the type becomes P2 as in pgm_read
+// data = matrix with at least img->height rows, the rest is not touched
+// stride = number of columns of the matrix, at least img->width
+void pgm_read_data(FILE *fp, pgm_t *img, cplx *data, int stride){
+    if(img->type[1] == '5' && img->max < 256){
+        // Rows of bytes are read at once
+        unsigned char *row = (unsigned char*)malloc(img->width);
+
+        for(int i = 0; i < img->height; i++){
+            size_t got = fread(row, 1, img->width, fp);
+            memset(row + got, 0, img->width - got);
+
+            for(int j = 0; j < img->width; j++){
+                data[(size_t)i * stride + j] = row[j];
             }
         }
 
-        double c = 255/log(1 + img_max);
-
-        for(int i = 0; i < img.height; i++){
-            for(int j = 0; j < img.width; j++){
-
-                double img_tmp = c * log(1 + cabs(img.data[i][j]));
-
-                fprintf(fpabs, "%0.lf ", img_tmp);
+        free(row);
+    } else {
+        for(int i = 0; i < img->height; i++){
+            for(int j = 0; j < img->width; j++){
+                data[(size_t)i * stride + j] = (cplx)_read_pixel(fp, img);
             }
-            fprintf(fpabs, "\n");
         }
-
-        fclose(fpabs);
     }
-    
-    
 
-} 
+    // The writers produce text images
+    strcpy(img->type, "P2");
+}
+
+// Function to read the next rows of an image as real values
+// fp = file positioned at the first of the rows
+// img = header of the image
+// rows = output, count rows of img->width values
+// count = number of rows
+void pgm_read_rows(FILE *fp, const pgm_t *img, real_t *rows, int count){
+    for(int i = 0; i < count; i++){
+        for(int j = 0; j < img->width; j++){
+            rows[(size_t)i * img->width + j] = _read_pixel(fp, img);
+        }
+    }
+}
 
 pgm_t pgm_read(char *filename){
     FILE *fp;
@@ -203,35 +333,25 @@ pgm_t pgm_read(char *filename){
 
     fp = fopen(filename, "rb");
 
-    if(fp == NULL){
+    if(fp == NULL || pgm_read_header(fp, &img) != 0){
         printf("Error opening file\n");
         exit(1);
     }
 
-    char buff[2048];
-    int tmp;
-
-    fgets(buff, sizeof(buff), fp);
-    sscanf(buff, "%s", img.type);
-
-    fgets(buff, sizeof(buff), fp);
-    sscanf(buff, "%d %d", &img.width, &img.height);
-
-    fgets(buff, sizeof(buff), fp);
-    sscanf(buff, "%d", &img.max);
-
     img.data = (cplx**)malloc(img.height * sizeof(cplx*));
 
     for(int i = 0; i < img.height; i++){
         img.data[i] = (cplx*)malloc(img.width * sizeof(cplx));
 
         for (int j = 0; j < img.width; j++){
-            fscanf(fp, "%d", &tmp);
-            img.data[i][j] = (cplx)tmp;
+            img.data[i][j] = (cplx)_read_pixel(fp, &img);
         }
         
     }
 
+    // The writers produce text images
+    strcpy(img.type, "P2");
+
     fclose(fp);
     return img;
 }
\ No newline at end of file
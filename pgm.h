@@ -1,9 +1,17 @@
 #ifndef PGM_H_
 #define PGM_H_
 
+#include <stdio.h>
 #include <complex.h>
 
+// Build with -DFFT_FLOAT to run the whole pipeline in single precision
+#ifdef FFT_FLOAT
+typedef float complex cplx;
+typedef float real_t;
+#else
 typedef double complex cplx;
+typedef double real_t;
+#endif
 
 typedef struct pgm{
     char type[3];
@@ -17,6 +25,20 @@ void pgm_write(pgm_t, char *, char *);
 
 void pgm_write_fft(pgm_t, char *, char *);
 
+void pgm_write_u8(char *, const unsigned char *, int, int, int);
+
+FILE *pgm_create_u8(char *, int, int, int);
+
+void pgm_write_u8_rows(FILE *, const unsigned char *, int, int);
+
+void pgm_write_frame(FILE *, const unsigned char *, int, int, int, int);
+
 pgm_t pgm_read(char *);
 
+int pgm_read_header(FILE *, pgm_t *);
+
+void pgm_read_data(FILE *, pgm_t *, cplx *, int);
+
+void pgm_read_rows(FILE *, const pgm_t *, real_t *, int);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,353 @@
+#include "pgm_mpi.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+
+// Largest number of bytes of one MPI-IO call (MPI counts are int)
+#ifndef PGM_MPI_IO_CHUNK
+#define PGM_MPI_IO_CHUNK INT_MAX
+#endif
+
+// Function to read bytes of a file with collective MPI-IO, in chunks of at most PGM_MPI_IO_CHUNK
+// Every rank takes part in the same number of collective calls, even with nothing left to read
+// comm = communicator that opened the file
+// fh = opened file
+// pos = byte offset of the first byte
+// buf = output vector of len bytes
+// len = number of bytes read by this rank
+static void _read_at_all(MPI_Comm comm, MPI_File fh, MPI_Offset pos, char *buf, size_t len){
+    long long chunks = (long long)((len + PGM_MPI_IO_CHUNK - 1) / PGM_MPI_IO_CHUNK);
+    MPI_Allreduce(MPI_IN_PLACE, &chunks, 1, MPI_LONG_LONG, MPI_MAX, comm);
+
+    size_t done = 0;
+    for(long long c = 0; c < chunks; c++){
+        int count = (len - done < PGM_MPI_IO_CHUNK) ? (int)(len - done) : PGM_MPI_IO_CHUNK;
+        MPI_File_read_at_all(fh, pos + (MPI_Offset)done, buf + done, count, MPI_CHAR, MPI_STATUS_IGNORE);
+        done += count;
+    }
+}
+
+// Function to write bytes of a file with collective MPI-IO, in chunks of at most PGM_MPI_IO_CHUNK
+// comm, fh, pos, len = see _read_at_all
+// buf = vector of len bytes
+static void _write_at_all(MPI_Comm comm, MPI_File fh, MPI_Offset pos, const char *buf, size_t len){
+    long long chunks = (long long)((len + PGM_MPI_IO_CHUNK - 1) / PGM_MPI_IO_CHUNK);
+    MPI_Allreduce(MPI_IN_PLACE, &chunks, 1, MPI_LONG_LONG, MPI_MAX, comm);
+
+    size_t done = 0;
+    for(long long c = 0; c < chunks; c++){
+        int count = (len - done < PGM_MPI_IO_CHUNK) ? (int)(len - done) : PGM_MPI_IO_CHUNK;
+        MPI_File_write_at_all(fh, pos + (MPI_Offset)done, buf + done, count, MPI_CHAR, MPI_STATUS_IGNORE);
+        done += count;
+    }
+}
+
+// Function to read the header of an image on rank 0 and share it with every rank
+// comm = communicator of the ranks that will read the image
+// filename = path of the image
+// img = type, width, height and max are filled on every rank
+// return = byte offset of the pixel data
+MPI_Offset pgm_mpi_read_header(MPI_Comm comm, char *filename, pgm_t *img){
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    long long offset = 0;
+    int info[3];
+
+    if(rank == 0){
+        FILE *fp = fopen(filename, "rb");
+
+        if(fp == NULL || pgm_read_header(fp, img) != 0){
+            printf("Error opening file\n");
+            MPI_Abort(comm, 1);
+        }
+
+        offset = ftell(fp);
+        fclose(fp);
+
+        info[0] = img->width;
+        info[1] = img->height;
+        info[2] = img->max;
+    }
+
+    MPI_Bcast(info, 3, MPI_INT, 0, comm);
+    MPI_Bcast(img->type, 3, MPI_CHAR, 0, comm);
+    MPI_Bcast(&offset, 1, MPI_LONG_LONG, 0, comm);
+
+    img->width = info[0];
+    img->height = info[1];
+    img->max = info[2];
+    img->data = NULL;
+
+    return (MPI_Offset)offset;
+}
+
+// Function to find the byte offset where each row of a P2 image starts
+// Every rank scans an equal share of the pixel data and the offsets are combined
+// fh = opened image
+// img = header of the image
+// offset = byte offset of the pixel data
+// rowoff = output vector of img.height + 1 offsets (the last one is the file size)
+static void _p2_row_offsets(MPI_Comm comm, MPI_File fh, const pgm_t img, MPI_Offset offset, long long *rowoff){
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    MPI_Offset file_size;
+    MPI_File_get_size(fh, &file_size);
+
+    long long len = file_size - offset;
+    long long chunk = (len + size - 1) / size;
+    long long start = offset + rank * chunk;
+    long long end = start + chunk;
+    if(start > file_size) start = file_size;
+    if(end > file_size) end = file_size;
+
+    // Read one byte before the slab to know if the first byte starts a number
+    long long read_start = (start > offset) ? start - 1 : start;
+    size_t read_len = (size_t)(end - read_start);
+    char *buf = (char*)malloc(read_len + 1);
+    _read_at_all(comm, fh, read_start, buf, read_len);
+
+    // Count the numbers that start inside this slab
+    long long my_tokens = 0;
+    for(long long b = start; b < end; b++){
+        int prev_space = (b == offset) || isspace((unsigned char)buf[b - 1 - read_start]);
+        if(prev_space && !isspace((unsigned char)buf[b - read_start])) my_tokens++;
+    }
+
+    long long first_token = 0;
+    MPI_Exscan(&my_tokens, &first_token, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if(rank == 0) first_token = 0;
+
+    for(int i = 0; i <= img.height; i++) rowoff[i] = -1;
+
+    long long t = first_token;
+    for(long long b = start; b < end; b++){
+        int prev_space = (b == offset) || isspace((unsigned char)buf[b - 1 - read_start]);
+        if(prev_space && !isspace((unsigned char)buf[b - read_start])){
+            if(t % img.width == 0 && t / img.width < img.height){
+                rowoff[t / img.width] = b;
+            }
+            t++;
+        }
+    }
+    rowoff[img.height] = file_size;
+
+    MPI_Allreduce(MPI_IN_PLACE, rowoff, img.height + 1, MPI_LONG_LONG, MPI_MAX, comm);
+
+    free(buf);
+}
+
+// Function to read a range of rows of an image with collective MPI-IO
+// Each rank reads only its own rows, so no rank needs the whole image
+// comm = communicator of the ranks that read the image
+// filename = path of the image
+// img = header read by pgm_mpi_read_header
+// offset = byte offset of the pixel data
+// first_row = first row to read
+// num_rows = number of rows to read (rows past the image height are zero)
+// rows = output vector of num_rows * stride elements
+// stride = length of each output row (columns past the image width are zero)
+void pgm_mpi_read_rows(MPI_Comm comm, char *filename, const pgm_t img, MPI_Offset offset, int first_row, int num_rows, cplx *rows, int stride){
+    MPI_File fh;
+
+    if(MPI_File_open(comm, filename, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS){
+        printf("Error opening file\n");
+        MPI_Abort(comm, 1);
+    }
+
+    // Rows of the padded image that exist in the file
+    int valid_rows = img.height - first_row;
+    if(valid_rows > num_rows) valid_rows = num_rows;
+    if(valid_rows < 0) valid_rows = 0;
+
+    memset(rows, 0, (size_t)num_rows * stride * sizeof(cplx));
+
+    if(strcmp(img.type, "P5") == 0){
+        int bpp = (img.max < 256) ? 1 : 2;
+
+        MPI_Datatype row_type;
+        MPI_Type_contiguous(img.width * bpp, MPI_BYTE, &row_type);
+        MPI_Type_commit(&row_type);
+
+        unsigned char *buf = (unsigned char*)malloc((size_t)valid_rows * img.width * bpp + 1);
+        MPI_Offset pos = offset + (MPI_Offset)first_row * img.width * bpp;
+        MPI_File_read_at_all(fh, pos, buf, valid_rows, row_type, MPI_STATUS_IGNORE);
+
+        for(int i = 0; i < valid_rows; i++){
+            for(int j = 0; j < img.width; j++){
+                const unsigned char *p = buf + ((size_t)i * img.width + j) * bpp;
+                rows[(size_t)i * stride + j] = (bpp == 1) ? p[0] : (p[0] << 8) | p[1];
+            }
+        }
+
+        free(buf);
+        MPI_Type_free(&row_type);
+    } else {
+        long long *rowoff = (long long*)malloc((img.height + 1) * sizeof(long long));
+        _p2_row_offsets(comm, fh, img, offset, rowoff);
+
+        long long start = (valid_rows > 0) ? rowoff[first_row] : 0;
+        long long end = (valid_rows > 0) ? rowoff[first_row + valid_rows] : 0;
+        size_t len = (size_t)(end - start);
+
+        char *buf = (char*)malloc(len + 1);
+        _read_at_all(comm, fh, start, buf, len);
+        buf[len] = '\0';
+
+        char *p = buf;
+        for(int i = 0; i < valid_rows; i++){
+            for(int j = 0; j < img.width; j++){
+                rows[(size_t)i * stride + j] = (cplx)strtol(p, &p, 10);
+            }
+        }
+
+        free(buf);
+        free(rowoff);
+    }
+
+    MPI_File_close(&fh);
+}
+
+// Function to write a range of rows of 8-bit pixels with collective MPI-IO
+// Rank 0 also writes the header, the ranks must own increasing row ranges
+// comm = communicator of the ranks that write the image
+// filename = path of the image
+// img = header of the image, pixels are clamped to max (P2 values are written as text)
+// num_rows = number of rows written by this rank
+// pixels = vector of num_rows * img.width bytes
+void pgm_mpi_write_rows_u8(MPI_Comm comm, char *filename, const pgm_t img, int num_rows, const unsigned char *pixels){
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    int is_p5 = (strcmp(img.type, "P5") == 0);
+    int bpp = (img.max < 256) ? 1 : 2;
+
+    size_t cap = (size_t)num_rows * img.width * (is_p5 ? bpp : 4) + 64;
+    size_t len = 0;
+    char *buf = (char*)malloc(cap);
+
+    if(rank == 0){
+        len += sprintf(buf, "%s\n%d %d\n%d\n", img.type, img.width, img.height, img.max);
+    }
+
+    for(int i = 0; i < num_rows; i++){
+        for(int j = 0; j < img.width; j++){
+            long q = pixels[(size_t)i * img.width + j];
+            if(q > img.max) q = img.max;
+
+            if(is_p5){
+                if(bpp == 2) buf[len++] = (char)(q >> 8);
+                buf[len++] = (char)(q & 0xff);
+            } else {
+                if(cap - len < 64){
+                    cap *= 2;
+                    buf = (char*)realloc(buf, cap);
+                }
+                len += sprintf(buf + len, "%ld ", q);
+            }
+        }
+        if(!is_p5){
+            buf[len++] = '\n';
+        }
+    }
+
+    long long my_len = (long long)len, pos = 0;
+    MPI_Exscan(&my_len, &pos, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if(rank == 0) pos = 0;
+
+    MPI_File fh;
+    if(MPI_File_open(comm, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS){
+        printf("Error opening file\n");
+        MPI_Abort(comm, 1);
+    }
+
+    MPI_File_set_size(fh, 0);
+    _write_at_all(comm, fh, pos, buf, len);
+    MPI_File_close(&fh);
+
+    free(buf);
+}
+
+// Function to write rows of 8-bit pixels at given positions with collective MPI-IO
+// Every row has a fixed size (P2 values are padded to the digits of max), so
+// a rank does not need to own a contiguous range of rows
+// comm = communicator of the ranks that write the image
+// filename = path of the image
+// img = header of the image, pixels are clamped to max
+// row_index = increasing global index of each local row
+// num_rows = number of rows written by this rank
+// pixels = vector of num_rows * img.width bytes
+void pgm_mpi_write_rows_at_u8(MPI_Comm comm, char *filename, const pgm_t img, const int *row_index, int num_rows, const unsigned char *pixels){
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    int is_p5 = (strcmp(img.type, "P5") == 0);
+    int bpp = (img.max < 256) ? 1 : 2;
+
+    int digits = 1;
+    for(int m = img.max; m >= 10; m /= 10) digits++;
+
+    char header[64];
+    int hlen = sprintf(header, "%s\n%d %d\n%d\n", img.type, img.width, img.height, img.max);
+
+    int row_bytes = is_p5 ? img.width * bpp : img.width * (digits + 1) + 1;
+    char *buf = (char*)malloc((size_t)num_rows * row_bytes + 1);
+    MPI_Aint *displs = (MPI_Aint*)malloc((num_rows + 1) * sizeof(MPI_Aint));
+
+    for(int i = 0; i < num_rows; i++){
+        char *row = buf + (size_t)i * row_bytes;
+        displs[i] = hlen + (MPI_Aint)row_index[i] * row_bytes;
+
+        for(int j = 0; j < img.width; j++){
+            long q = pixels[(size_t)i * img.width + j];
+            if(q > img.max) q = img.max;
+
+            if(is_p5){
+                if(bpp == 2) *row++ = (char)(q >> 8);
+                *row++ = (char)(q & 0xff);
+            } else {
+                // Right-aligned digits followed by a space
+                for(int d = digits - 1; d >= 0; d--){
+                    row[d] = (d == digits - 1 || q > 0) ? (char)('0' + q % 10) : ' ';
+                    q /= 10;
+                }
+                row[digits] = ' ';
+                row += digits + 1;
+            }
+        }
+        if(!is_p5){
+            *row = '\n';
+        }
+    }
+
+    MPI_File fh;
+    if(MPI_File_open(comm, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS){
+        printf("Error opening file\n");
+        MPI_Abort(comm, 1);
+    }
+
+    MPI_File_set_size(fh, 0);
+    if(rank == 0){
+        MPI_File_write_at(fh, 0, header, hlen, MPI_CHAR, MPI_STATUS_IGNORE);
+    }
+
+    // The rows are counted as row_type, so num_rows * row_bytes may pass INT_MAX
+    MPI_Datatype row_type, file_type;
+    MPI_Type_contiguous(row_bytes, MPI_BYTE, &row_type);
+    MPI_Type_commit(&row_type);
+    MPI_Type_create_hindexed_block(num_rows, row_bytes, displs, MPI_BYTE, &file_type);
+    MPI_Type_commit(&file_type);
+
+    MPI_File_set_view(fh, 0, MPI_BYTE, file_type, "native", MPI_INFO_NULL);
+    MPI_File_write_all(fh, buf, num_rows, row_type, MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+
+    MPI_Type_free(&row_type);
+    MPI_Type_free(&file_type);
+    free(displs);
+    free(buf);
+}
@@ -0,0 +1,22 @@
+#ifndef PGM_MPI_H_
+#define PGM_MPI_H_
+
+#include <mpi.h>
+#include "pgm.h"
+
+// MPI datatype of cplx
+#ifdef FFT_FLOAT
+#define MPI_CPLX MPI_C_FLOAT_COMPLEX
+#else
+#define MPI_CPLX MPI_C_DOUBLE_COMPLEX
+#endif
+
+MPI_Offset pgm_mpi_read_header(MPI_Comm, char *, pgm_t *);
+
+void pgm_mpi_read_rows(MPI_Comm, char *, const pgm_t, MPI_Offset, int, int, cplx *, int);
+
+void pgm_mpi_write_rows_u8(MPI_Comm, char *, const pgm_t, int, const unsigned char *);
+
+void pgm_mpi_write_rows_at_u8(MPI_Comm, char *, const pgm_t, const int *, int, const unsigned char *);
+
+#endif
@@ -0,0 +1,236 @@
+#include "phasecorr.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define PI 3.14159265358979323846
+
+// Width of the Gaussian weight of the cross-power spectrum, in cycles per pixel
+#define PHASECORR_SIGMA 0.12
+
+// Phase correlation: with A the spectrum of a frame and R the spectrum of the
+// reference, the inverse of (A / |A|) * conj(R / |R|) is a peak at the shift
+// of the frame, whatever the contents of the images. The cross-power spectrum
+// is also weighted by a Gaussian: the high frequencies, where the noise is
+// as strong as the image once the magnitudes are divided out, count less and
+// the peak becomes a Gaussian, whose top is found exactly from three values
+
+static int _pow2(int num){
+    int power = 1;
+    while(power < num){
+        power *= 2;
+    }
+    return power;
+}
+
+// Function to put an image in the padded buffer of a transform
+// The mean is removed and the window applied, so the borders of the image
+// do not correlate with the zero padding
+// pc = reference
+// image = pc->height rows of pc->width pixels
+// d = real values of the buffer, the image goes at d[2 * (y * pw + x)]
+static void _load(const phasecorr_t* pc, const real_t* image, real_t* d){
+    int pw = pc->row_plan->n;
+    size_t size = (size_t)pc->width * pc->height;
+    const real_t* wx = pc->window;
+    const real_t* wy = pc->window + pc->width;
+
+    double mean = 0;
+    for(size_t i = 0; i < size; i++){
+        mean += image[i];
+    }
+    mean /= size;
+
+    for(int y = 0; y < pc->height; y++){
+        const real_t* src = image + (size_t)y * pc->width;
+        real_t* dst = d + 2 * (size_t)y * pw;
+        for(int x = 0; x < pc->width; x++){
+            dst[2 * x] = (src[x] - mean) * wx[x] * wy[y];
+        }
+    }
+}
+
+// Function to refine the position of a peak along one axis
+// A Gaussian is fitted to the peak and its two neighbours (a parabola on the logs)
+// left, center, right = values at the peak and next to it
+// return = offset of the top of the Gaussian, between -0.5 and 0.5
+static double _subpixel(double left, double center, double right){
+    if(left <= 0 || center <= 0 || right <= 0){
+        return 0;
+    }
+
+    double l = log(left);
+    double c = log(center);
+    double r = log(right);
+    double curvature = l - 2 * c + r;
+    if(curvature >= 0){
+        return 0;
+    }
+
+    double offset = 0.5 * (l - r) / curvature;
+    return (offset < -0.5) ? -0.5 : (offset > 0.5) ? 0.5 : offset;
+}
+
+// Function to find the peak of a correlation surface
+// c = real values of the surface, ph rows of pw elements at c[2 * (y * pw + x)]
+// pw, ph = size of the surface
+// scale = factor of the values, so a pure shift has a peak of 1
+// shift = output
+static void _peak(const real_t* c, int pw, int ph, double scale, phasecorr_shift_t* shift){
+    size_t best = 0;
+    for(size_t i = 1; i < (size_t)pw * ph; i++){
+        if(c[2 * i] > c[2 * best]){
+            best = i;
+        }
+    }
+
+    int y = (int)(best / pw);
+    int x = (int)(best % pw);
+
+    // The surface is circular: the neighbours wrap around
+    double center = c[2 * best];
+    double dx = x + _subpixel(c[2 * ((size_t)y * pw + (x + pw - 1) % pw)], center, c[2 * ((size_t)y * pw + (x + 1) % pw)]);
+    double dy = y + _subpixel(c[2 * ((size_t)((y + ph - 1) % ph) * pw + x)], center, c[2 * ((size_t)((y + 1) % ph) * pw + x)]);
+
+    // Shifts past the half are negative
+    shift->dx = (dx >= pw / 2) ? dx - pw : dx;
+    shift->dy = (dy >= ph / 2) ? dy - ph : dy;
+    shift->peak = center * scale;
+}
+
+// Function to prepare the reference of a registration
+// Its spectrum is computed once and shared by every frame
+// reference = height rows of width pixels
+// width, height = size of the reference and of the frames
+// window = apply a Hann window to the images, for images that do not wrap around
+// plan_mode = FFT_MEASURE or FFT_ESTIMATE
+// return = reference
+phasecorr_t* phasecorr_create(const real_t* reference, int width, int height, int window, int plan_mode){
+    phasecorr_t* pc = (phasecorr_t*)malloc(sizeof(phasecorr_t));
+    pc->width = width;
+    pc->height = height;
+
+    int pw = _pow2(width);
+    int ph = _pow2(height);
+    pc->row_plan = fft_plan_create(pw, plan_mode);
+    pc->col_plan = (ph == pw) ? pc->row_plan : fft_plan_create(ph, plan_mode);
+
+    pc->window = (real_t*)malloc((width + height) * sizeof(real_t));
+    for(int x = 0; x < width; x++){
+        pc->window[x] = (window && width > 1) ? 0.5 - 0.5 * cos(2 * PI * x / (width - 1)) : 1;
+    }
+    for(int y = 0; y < height; y++){
+        pc->window[width + y] = (window && height > 1) ? 0.5 - 0.5 * cos(2 * PI * y / (height - 1)) : 1;
+    }
+
+    size_t size = (size_t)pw * ph;
+    cplx* v = (cplx*)calloc(size, sizeof(cplx));
+    pc->spectrum = (cplx*)malloc(size * sizeof(cplx));
+
+    _load(pc, reference, (real_t*)v);
+    fft_execute_2d(pc->row_plan, pc->col_plan, v, pc->spectrum, height, 0);
+
+    // Unit magnitudes times the weight, in the transposed layout (pw rows of ph)
+    double gain = 0;
+    for(int r = 0; r < pw; r++){
+        double fx = ((r < pw / 2) ? r : r - pw) / (double)pw;
+
+        for(int c = 0; c < ph; c++){
+            double fy = ((c < ph / 2) ? c : c - ph) / (double)ph;
+            double weight = exp(-(fx * fx + fy * fy) / (2 * PHASECORR_SIGMA * PHASECORR_SIGMA));
+            cplx* s = &pc->spectrum[(size_t)r * ph + c];
+            double magnitude = cabs(*s);
+
+            *s = (magnitude > 0) ? conj(*s) * (weight / magnitude) : 0;
+            gain += weight;
+        }
+    }
+    pc->scale = 1.0 / gain;
+
+    free(v);
+    return pc;
+}
+
+// Function to find the shifts of frames relative to the reference
+// The images are real, so two frames go through one complex transform, in
+// the real and in the imaginary parts. Their spectra are separated with
+// A = (Z + Z') / 2 and B = (Z - Z') / 2i, where Z' = conj(Z(-k)), and the
+// two cross-power spectra go back together through one inverse, whose real
+// and imaginary parts are the two correlations. The pairs of frames are
+// divided among the threads, each with its own buffers
+// pc = reference
+// frames = count images of the size of the reference
+// count = number of frames
+// shifts = output, one per frame
+void phasecorr_frames(const phasecorr_t* pc, const real_t* const* frames, int count, phasecorr_shift_t* shifts){
+    int pw = pc->row_plan->n;
+    int ph = pc->col_plan->n;
+    int pairs = (count + 1) / 2;
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        size_t size = (size_t)pw * ph;
+        cplx* v = (cplx*)malloc(size * sizeof(cplx));
+        cplx* w = (cplx*)malloc(size * sizeof(cplx));
+
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for(int p = 0; p < pairs; p++){
+            int second = (2 * p + 1 < count);
+
+            // Frame 2p in the real part and frame 2p + 1 in the imaginary part
+            memset(v, 0, size * sizeof(cplx));
+            real_t* d = (real_t*)v;
+            _load(pc, frames[2 * p], d);
+            if(second){
+                _load(pc, frames[2 * p + 1], d + 1);
+            }
+
+            fft_execute_2d(pc->row_plan, pc->col_plan, v, w, pc->height, 0);
+
+            // Cross-power spectra, in the transposed layout (pw rows of ph)
+            for(int r = 0; r < pw; r++){
+                int r2 = (pw - r) % pw;
+
+                for(int c = 0; c < ph; c++){
+                    int c2 = (ph - c) % ph;
+                    cplx z = w[(size_t)r * ph + c];
+                    cplx m = conj(w[(size_t)r2 * ph + c2]);
+                    cplx s = pc->spectrum[(size_t)r * ph + c];
+
+                    cplx a = (z + m) / 2;
+                    cplx b = (z - m) / (2 * I);
+                    double ma = cabs(a);
+                    double mb = cabs(b);
+
+                    cplx ra = (ma > 0) ? a * s / ma : 0;
+                    cplx rb = (mb > 0) ? b * s / mb : 0;
+                    v[(size_t)r * ph + c] = ra + I * rb;
+                }
+            }
+
+            fft_execute_2d(pc->row_plan, pc->col_plan, v, w, ph, 1);
+
+            _peak((const real_t*)w, pw, ph, pc->scale, &shifts[2 * p]);
+            if(second){
+                _peak((const real_t*)w + 1, pw, ph, pc->scale, &shifts[2 * p + 1]);
+            }
+        }
+
+        free(v);
+        free(w);
+    }
+}
+
+// Function to free a reference
+// pc = reference
+void phasecorr_destroy(phasecorr_t* pc){
+    if(pc->col_plan != pc->row_plan) fft_plan_destroy(pc->col_plan);
+    fft_plan_destroy(pc->row_plan);
+    free(pc->window);
+    free(pc->spectrum);
+    free(pc);
+}
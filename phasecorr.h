@@ -0,0 +1,32 @@
+#ifndef PHASECORR_H_
+#define PHASECORR_H_
+
+#include "pgm.h"
+#include "fft_plan.h"
+
+// Shift of a frame relative to the reference, see phasecorr_frames
+typedef struct phasecorr_shift{
+    double dx;      // the frame is the reference moved dx columns to the right
+    double dy;      // and dy rows down
+    double peak;    // height of the correlation peak, 1 for a pure shift
+}phasecorr_shift_t;
+
+// Reference of a registration, see phasecorr_create
+typedef struct phasecorr{
+    int width;          // size of the images
+    int height;
+    fft_plan_t* row_plan;   // plans of the padded size (powers of 2)
+    fft_plan_t* col_plan;
+    real_t* window;     // width + height factors of the separable window, all 1 without it
+    cplx* spectrum;     // conjugate of the reference spectrum with unit magnitudes
+                        // times the weight, transposed
+    double scale;       // 1 / sum of the weights, the peak of a pure shift is 1
+}phasecorr_t;
+
+phasecorr_t* phasecorr_create(const real_t*, int, int, int, int);
+
+void phasecorr_frames(const phasecorr_t*, const real_t* const*, int, phasecorr_shift_t*);
+
+void phasecorr_destroy(phasecorr_t*);
+
+#endif
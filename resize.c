@@ -0,0 +1,150 @@
+#include "resize.h"
+#include "fft_plan.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Spectral resampling: the spectrum of each line is cropped around the low
+// frequencies to shrink it, which is an exact low-pass with nothing aliased,
+// or padded with zeros to enlarge it, and the inverse is taken at the new
+// size. Resizing is separable, so the rows and the columns are done in turn,
+// each with transforms of the exact sizes (Bluestein for the other sizes)
+
+// Function to move the spectrum of a line to the spectrum of the resized line
+// The frequency on the border of the smaller spectrum (n / 2 for an even n)
+// is split between +n / 2 and -n / 2 when enlarging, and the two are added
+// when shrinking, so a real line stays real. This is linear and keeps the
+// symmetry of the spectra of real lines, which lets two real lines share
+// one complex transform
+// a = spectrum of n elements
+// n = size of the line
+// b = output, spectrum of m elements, divided by n so the inverse keeps the values
+// m = size of the resized line
+static void _resample_bins(const cplx* a, int n, cplx* b, int m){
+    int small = (n < m) ? n : m;
+    int half = (small - 1) / 2;
+    double scale = 1.0 / n;
+
+    memset(b, 0, m * sizeof(cplx));
+    b[0] = a[0] * scale;
+    for(int k = 1; k <= half; k++){
+        b[k] = a[k] * scale;
+        b[m - k] = a[n - k] * scale;
+    }
+
+    if(small % 2 == 0 && small > 0){
+        int k = small / 2;
+        if(n > m){
+            b[k] = (a[k] + a[n - k]) * scale;
+        } else if(n < m){
+            b[k] = a[k] * (scale / 2);
+            b[m - k] = a[k] * (scale / 2);
+        } else {
+            b[k] = a[k] * scale;
+        }
+    }
+}
+
+// Function to resize lines of a matrix along one axis
+// The lines are real, so two go through each transform, one in the real
+// and one in the imaginary part, and come back the same way. The pairs of
+// lines are divided among the threads, each with its own buffers
+// in = lines of n values, element j of line l at in[l * in_line + j * in_step]
+// out = lines of m values, element j of line l at out[l * out_line + j * out_step]
+// lines = number of lines
+// plan_n, plan_m = plans of size n and m
+static void _resize_lines(const real_t* in, size_t in_line, size_t in_step, real_t* out, size_t out_line, size_t out_step,
+                          int lines, const fft_plan_t* plan_n, const fft_plan_t* plan_m){
+    int n = plan_n->n;
+    int m = plan_m->n;
+    int pairs = (lines + 1) / 2;
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        cplx* a = (cplx*)malloc(n * sizeof(cplx));
+        cplx* b = (cplx*)malloc(m * sizeof(cplx));
+
+        // Neighbouring pairs share cache lines when the lines are columns
+#ifdef _OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for(int p = 0; p < pairs; p++){
+            const real_t* first = in + (size_t)(2 * p) * in_line;
+            int second = (2 * p + 1 < lines);
+
+            for(int j = 0; j < n; j++){
+                a[j] = first[j * in_step];
+                if(second){
+                    a[j] += I * first[in_line + j * in_step];
+                }
+            }
+
+            fft_execute(plan_n, a, 0);
+            _resample_bins(a, n, b, m);
+            fft_execute(plan_m, b, 1);
+
+            real_t* dst = out + (size_t)(2 * p) * out_line;
+            for(int j = 0; j < m; j++){
+                dst[j * out_step] = creal(b[j]);
+                if(second){
+                    dst[out_line + j * out_step] = cimag(b[j]);
+                }
+            }
+        }
+
+        free(a);
+        free(b);
+    }
+}
+
+// Function to resize the rows or the columns of an image
+// src = height rows of width values
+// width, height = size of src
+// dst = output, the resized image
+// size = new width if rows, new height otherwise
+// rows = 1 to resize the rows, 0 to resize the columns
+// plan_mode = FFT_MEASURE or FFT_ESTIMATE
+static void _resize_axis(const real_t* src, int width, int height, real_t* dst, int size, int rows, int plan_mode){
+    int n = (rows) ? width : height;
+    if(n == size){
+        memcpy(dst, src, (size_t)width * height * sizeof(real_t));
+        return;
+    }
+
+    fft_plan_t* plan_n = fft_plan_create(n, plan_mode);
+    fft_plan_t* plan_m = fft_plan_create(size, plan_mode);
+
+    if(rows){
+        _resize_lines(src, width, 1, dst, size, 1, height, plan_n, plan_m);
+    } else {
+        _resize_lines(src, 1, width, dst, 1, width, width, plan_n, plan_m);
+    }
+
+    fft_plan_destroy(plan_n);
+    fft_plan_destroy(plan_m);
+}
+
+// Function to resize an image with the spectral method
+// The axis that shrinks the most goes first, so the intermediate image is
+// the smaller one. An axis that keeps its size is not transformed
+// image = height rows of width values
+// width, height = size of the image
+// out = output, new_height rows of new_width values
+// new_width, new_height = size of the resized image
+// plan_mode = FFT_MEASURE or FFT_ESTIMATE
+void resize_spectral(const real_t* image, int width, int height, real_t* out, int new_width, int new_height, int plan_mode){
+    int rows_first = (double)new_width / width <= (double)new_height / height;
+
+    if(rows_first){
+        real_t* mid = (real_t*)malloc((size_t)new_width * height * sizeof(real_t));
+        _resize_axis(image, width, height, mid, new_width, 1, plan_mode);
+        _resize_axis(mid, new_width, height, out, new_height, 0, plan_mode);
+        free(mid);
+    } else {
+        real_t* mid = (real_t*)malloc((size_t)width * new_height * sizeof(real_t));
+        _resize_axis(image, width, height, mid, new_height, 0, plan_mode);
+        _resize_axis(mid, width, new_height, out, new_width, 1, plan_mode);
+        free(mid);
+    }
+}
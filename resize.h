@@ -0,0 +1,8 @@
+#ifndef RESIZE_H_
+#define RESIZE_H_
+
+#include "pgm.h"
+
+void resize_spectral(const real_t*, int, int, real_t*, int, int, int);
+
+#endif
@@ -0,0 +1,96 @@
+#define _POSIX_C_SOURCE 200809L
+#include "ring.h"
+#include <stdlib.h>
+#include <sched.h>
+#include <time.h>
+
+// Function to create a ring
+// capacity = minimum number of slots
+// return = ring with a power of 2 number of slots
+ring_t* ring_create(size_t capacity){
+    size_t size = 1;
+    while(size < capacity){
+        size *= 2;
+    }
+
+    ring_t *r = (ring_t*)malloc(sizeof(ring_t));
+    r->slots = (void**)malloc(size * sizeof(void*));
+    r->mask = size - 1;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    return r;
+}
+
+// Function to push a pointer, from the producer thread
+// r = ring
+// item = pointer
+// return = 1 if it was pushed, 0 if the ring is full
+int ring_push(ring_t *r, void *item){
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+    if(tail - head > r->mask){
+        return 0;
+    }
+
+    r->slots[tail & r->mask] = item;
+    atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+    return 1;
+}
+
+// Function to pop a pointer, from the consumer thread
+// r = ring
+// item = output, the oldest pointer
+// return = 1 if a pointer was popped, 0 if the ring is empty
+int ring_pop(ring_t *r, void **item){
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+    if(head == tail){
+        return 0;
+    }
+
+    *item = r->slots[head & r->mask];
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+    return 1;
+}
+
+// Function to wait for the other side of a ring
+// Yields the processor first and then sleeps, so a waiting stage does not
+// take the cores of the transform
+// spins = number of times the ring was found full or empty
+static void _backoff(int spins){
+    if(spins < 64){
+        sched_yield();
+    } else {
+        struct timespec pause = {0, 20000};
+        nanosleep(&pause, NULL);
+    }
+}
+
+// Function to push a pointer, waiting while the ring is full
+// r = ring
+// item = pointer
+void ring_push_wait(ring_t *r, void *item){
+    for(int spins = 0; !ring_push(r, item); spins++){
+        _backoff(spins);
+    }
+}
+
+// Function to pop a pointer, waiting while the ring is empty
+// r = ring
+// return = the oldest pointer
+void* ring_pop_wait(ring_t *r){
+    void *item;
+    for(int spins = 0; !ring_pop(r, &item); spins++){
+        _backoff(spins);
+    }
+    return item;
+}
+
+// Function to free a ring
+// r = ring
+void ring_destroy(ring_t *r){
+    free(r->slots);
+    free(r);
+}
@@ -0,0 +1,32 @@
+#ifndef RING_H_
+#define RING_H_
+
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Lock-free queue of pointers between one producer thread and one consumer
+// thread. Only the producer writes tail and only the consumer writes head,
+// each on its own cache line
+typedef struct ring{
+    void **slots;
+    size_t mask;                // capacity - 1, the capacity is a power of 2
+    char pad0[64];
+    _Atomic size_t head;        // next slot to pop
+    char pad1[64];
+    _Atomic size_t tail;        // next slot to push
+    char pad2[64];
+}ring_t;
+
+ring_t* ring_create(size_t);
+
+int ring_push(ring_t *, void *);
+
+int ring_pop(ring_t *, void **);
+
+void ring_push_wait(ring_t *, void *);
+
+void* ring_pop_wait(ring_t *);
+
+void ring_destroy(ring_t *);
+
+#endif
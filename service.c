@@ -0,0 +1,117 @@
+#define _POSIX_C_SOURCE 200809L
+#include "service.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Function to send a message, with a file descriptor
+// sock = connected socket
+// buf, len = message
+// fd = descriptor sent with the message, -1 for none
+// return = 0 on success, -1 on error
+int service_send(int sock, const void *buf, size_t len, int fd){
+    struct iovec iov = {(void*)buf, len};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    union{
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    }control;
+
+    if(fd >= 0){
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    ssize_t sent;
+    do{
+        sent = sendmsg(sock, &msg, 0);
+    }while(sent < 0 && errno == EINTR);
+
+    if(sent < 0){
+        return -1;
+    }
+
+    // The descriptor went with the first byte, the rest is plain data
+    const char *rest = (const char*)buf + sent;
+    len -= sent;
+    while(len > 0){
+        ssize_t w = write(sock, rest, len);
+        if(w < 0 && errno == EINTR) continue;
+        if(w <= 0) return -1;
+        rest += w;
+        len -= w;
+    }
+    return 0;
+}
+
+// Function to read exactly len bytes
+// sock = connected socket
+// buf, len = output
+// return = 0 on success, -1 on error or end of the connection
+int service_read(int sock, void *buf, size_t len){
+    char *p = (char*)buf;
+    while(len > 0){
+        ssize_t r = read(sock, p, len);
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) return -1;
+        p += r;
+        len -= r;
+    }
+    return 0;
+}
+
+// Function to receive a message, with a file descriptor
+// sock = connected socket
+// buf, len = output, exactly len bytes
+// fd = output, the descriptor sent with the message or -1
+// return = 0 on success, -1 on error or end of the connection
+int service_recv(int sock, void *buf, size_t len, int *fd){
+    struct iovec iov = {buf, len};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    union{
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    }control;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    *fd = -1;
+
+    ssize_t got;
+    do{
+        got = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    }while(got < 0 && errno == EINTR);
+
+    if(got <= 0){
+        return -1;
+    }
+
+    for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS){
+            memcpy(fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+
+    if(service_read(sock, (char*)buf + got, len - got) != 0){
+        if(*fd >= 0) close(*fd);
+        *fd = -1;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,84 @@
+#ifndef SERVICE_H_
+#define SERVICE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Protocol of fft_server over a Unix domain socket. A client connects, sends
+// one request and receives one reply. File descriptors go with the messages
+// (SCM_RIGHTS): the image of a job can be an open file, and the outputs of a
+// job come back in a memfd, so the pixels are never copied through the socket
+
+#define SERVICE_MAGIC 0x4a544646u     // "FFTJ"
+
+// Kinds of request
+#define SERVICE_JOB 1
+#define SERVICE_STATS 2
+
+// Sources of the image of a job
+#define SERVICE_SRC_PATH 1      // path of length bytes after the request
+#define SERVICE_SRC_FD 2        // open file sent with the request
+#define SERVICE_SRC_INLINE 3    // the PGM file itself after the request
+
+// Outputs of a job, bits of outputs
+#define SERVICE_OUT_IMAGE 1         // filtered image, width x height bytes
+#define SERVICE_OUT_SPECTRUM 2      // spectrum, n x n bytes
+#define SERVICE_OUT_FILTERED 4      // filtered spectrum, n x n bytes
+#define SERVICE_OUTPUTS 3
+
+// Status of a reply
+#define SERVICE_OK 0
+#define SERVICE_ERR_REQUEST 1
+#define SERVICE_ERR_IMAGE 2
+
+typedef struct service_request{
+    uint32_t magic;
+    uint16_t kind;
+    uint16_t outputs;
+    uint32_t source;
+    uint32_t length;
+    int32_t filter_type;    // see filter_spec_t
+    int32_t pad;
+    double filter_low;
+    double filter_high;
+}service_request_t;
+
+typedef struct service_reply{
+    uint32_t magic;
+    int32_t status;
+    int32_t width;
+    int32_t height;
+    int32_t max;
+    int32_t n;
+    uint64_t offset[SERVICE_OUTPUTS];   // position of each output in the memfd
+    uint64_t size[SERVICE_OUTPUTS];     // 0 if the output was not requested
+    double queue_ms;                    // waiting for a worker
+    double run_ms;                      // reading, filtering and writing the outputs
+}service_reply_t;
+
+// Latencies are over the last SERVICE_WINDOW jobs
+#define SERVICE_WINDOW 1024
+
+typedef struct service_stats{
+    uint32_t magic;
+    int32_t status;
+    int32_t threads;
+    int32_t busy;           // workers running a job
+    int32_t queue_depth;    // jobs waiting for a worker
+    int32_t pad;
+    uint64_t jobs;
+    uint64_t errors;
+    double uptime_s;
+    double p50_ms;
+    double p90_ms;
+    double p99_ms;
+    double max_ms;
+}service_stats_t;
+
+int service_send(int, const void *, size_t, int);
+
+int service_recv(int, void *, size_t, int *);
+
+int service_read(int, void *, size_t);
+
+#endif
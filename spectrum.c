@@ -0,0 +1,92 @@
+#include "spectrum.h"
+#include <string.h>
+#include <math.h>
+
+// Function to find the largest squared magnitude of a vector
+// v = vector
+// n = number of elements
+// return = largest re^2 + im^2
+double spectrum_max_sq(const cplx* v, size_t n){
+    const real_t* d = (const real_t*)v;
+    double max_sq = 0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for simd reduction(max:max_sq)
+#endif
+    for(size_t i = 0; i < n; i++){
+        double re = d[2 * i];
+        double im = d[2 * i + 1];
+        double s = re * re + im * im;
+        max_sq = (s > max_sq) ? s : max_sq;
+    }
+
+    return max_sq;
+}
+
+// Function to convert a vector to 8-bit log-scaled magnitudes
+// The level of an element is round(c * log(1 + |v|)) with c = 255 / log(1 + max),
+// as in pgm_write_fft. Instead of a sqrt and a log per element, the squared
+// magnitude is compared with the 255 squared magnitudes where the level changes,
+// by binary search in a table of 256 doubles
+// v = vector
+// n = number of elements
+// max_sq = squared magnitude that gets the level 255
+// out = n levels
+void spectrum_log_u8(const cplx* v, size_t n, double max_sq, unsigned char* out){
+    if(max_sq <= 0){
+        memset(out, 0, n);
+        return;
+    }
+
+    // t[k] = smallest squared magnitude with a level above k
+    double t[256];
+    double c = 255 / log(1 + sqrt(max_sq));
+    for(int k = 0; k < 255; k++){
+        double e = exp((k + 0.5) / c) - 1;
+        t[k] = e * e;
+    }
+    t[255] = HUGE_VAL;
+
+    const real_t* d = (const real_t*)v;
+
+#ifdef _OPENMP
+    #pragma omp parallel for simd
+#endif
+    for(size_t i = 0; i < n; i++){
+        double re = d[2 * i];
+        double im = d[2 * i + 1];
+        double s = re * re + im * im;
+
+        int k = 0;
+        k += (s >= t[k + 127]) ? 128 : 0;
+        k += (s >= t[k + 63]) ? 64 : 0;
+        k += (s >= t[k + 31]) ? 32 : 0;
+        k += (s >= t[k + 15]) ? 16 : 0;
+        k += (s >= t[k + 7]) ? 8 : 0;
+        k += (s >= t[k + 3]) ? 4 : 0;
+        k += (s >= t[k + 1]) ? 2 : 0;
+        k += (s >= t[k]) ? 1 : 0;
+
+        out[i] = (unsigned char)k;
+    }
+}
+
+// Function to convert a vector to 8-bit magnitudes
+// v = vector
+// n = number of elements
+// scale = factor applied to the magnitudes
+// out = n pixels, round(scale * |v|) clamped to 255
+void spectrum_abs_u8(const cplx* v, size_t n, double scale, unsigned char* out){
+    const real_t* d = (const real_t*)v;
+
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for(size_t i = 0; i < n; i++){
+        double re = d[2 * i];
+        double im = d[2 * i + 1];
+        double level = nearbyint(sqrt(re * re + im * im) * scale);
+
+        out[i] = (level > 255) ? 255 : (unsigned char)level;
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef SPECTRUM_H_
+#define SPECTRUM_H_
+
+#include <stddef.h>
+#include "pgm.h"
+
+double spectrum_max_sq(const cplx*, size_t);
+
+void spectrum_log_u8(const cplx*, size_t, double, unsigned char*);
+
+void spectrum_abs_u8(const cplx*, size_t, double, unsigned char*);
+
+#endif
@@ -0,0 +1,252 @@
+#define _POSIX_C_SOURCE 200809L
+#include "spectrum_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Cached forward spectra of images, addressed by the hash of the image file.
+// Each entry is a header followed by the n x n spectrum, mapped with mmap on
+// a hit. The directory is kept under a size limit by removing the entries
+// that were used least recently (the mtime is updated on every hit)
+
+#define CACHE_MAGIC "FFTSPEC1"
+#define CACHE_HEADER 64
+
+typedef struct{
+    char magic[8];
+    int32_t n;          // size of the padded spectrum
+    int32_t width;      // size of the original image
+    int32_t height;
+    int32_t max;
+    int32_t real_size;  // sizeof(real_t) of the build that wrote it
+}cache_header_t;
+
+static const char* _precision(void){
+    return (sizeof(real_t) == sizeof(float)) ? "float" : "double";
+}
+
+// Function to find the cache directory: $FFT_SPECTRUM_CACHE, or
+// projeto_fft/spectra inside $XDG_CACHE_HOME or ~/.cache. The directories are created
+// path = output path
+// size = size of path
+// return = 0 on success, -1 if there is no place for the cache
+static int _cache_dir(char *path, size_t size){
+    const char *env = getenv("FFT_SPECTRUM_CACHE");
+    if(env != NULL){
+        snprintf(path, size, "%s", env);
+        mkdir(path, 0755);
+        return 0;
+    }
+
+    char dir[1024];
+    const char *cache = getenv("XDG_CACHE_HOME");
+    if(cache != NULL && cache[0] != '\0'){
+        snprintf(dir, sizeof(dir), "%s", cache);
+    } else if(getenv("HOME") != NULL){
+        snprintf(dir, sizeof(dir), "%s/.cache", getenv("HOME"));
+        mkdir(dir, 0755);
+    } else {
+        return -1;
+    }
+
+    snprintf(path, size, "%s/projeto_fft", dir);
+    mkdir(path, 0755);
+
+    snprintf(path, size, "%s/projeto_fft/spectra", dir);
+    mkdir(path, 0755);
+    return 0;
+}
+
+// Function to get the size limit of the cache: $FFT_SPECTRUM_CACHE_MB, 1 GB by default
+// return = limit in bytes, 0 disables the cache
+static long long _cache_limit(void){
+    const char *env = getenv("FFT_SPECTRUM_CACHE_MB");
+    long long mb = (env != NULL) ? atoll(env) : 1024;
+    return (mb > 0) ? mb * 1024 * 1024 : 0;
+}
+
+// Function to find the file of a cache entry
+// return = 0 on success, -1 if there is no place for the cache
+static int _cache_path(uint64_t key, char *path, size_t size){
+    char dir[1100];
+    if(_cache_dir(dir, sizeof(dir)) != 0) return -1;
+
+    snprintf(path, size, "%s/%016llx_%s.spec", dir, (unsigned long long)key, _precision());
+    return 0;
+}
+
+// Function to hash the bytes of an image file (FNV-1a)
+// filename = path of the image
+// return = key of the image, 0 if it cannot be read or the cache is disabled
+uint64_t spectrum_cache_key(const char *filename){
+    if(_cache_limit() == 0) return 0;
+
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) return 0;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size == 0){
+        close(fd);
+        return 0;
+    }
+
+    const unsigned char *bytes = (const unsigned char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(bytes == MAP_FAILED) return 0;
+
+    uint64_t hash = 14695981039346656037ULL;
+    for(off_t i = 0; i < st.st_size; i++){
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+
+    munmap((void*)bytes, st.st_size);
+    return (hash != 0) ? hash : 1;
+}
+
+// Function to map the cached spectrum of an image
+// The mapping is private: the pipeline can work on it in place without
+// changing the file
+// key = key of the image
+// img = width, height, max and type of the original image are filled
+// n = size of the spectrum
+// return = n x n spectrum, or NULL on a miss
+cplx* spectrum_cache_load(uint64_t key, pgm_t *img, int *n){
+    char path[1200];
+    if(key == 0 || _cache_path(key, path, sizeof(path)) != 0) return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return NULL;
+
+    cache_header_t header;
+    struct stat st;
+    if(read(fd, &header, sizeof(header)) != sizeof(header) || fstat(fd, &st) != 0 ||
+       memcmp(header.magic, CACHE_MAGIC, 8) != 0 || header.real_size != (int32_t)sizeof(real_t) ||
+       st.st_size != CACHE_HEADER + (off_t)header.n * header.n * (off_t)sizeof(cplx)){
+        close(fd);
+        return NULL;
+    }
+
+    char *map = (char*)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return NULL;
+
+    // Most recently used
+    utimensat(AT_FDCWD, path, NULL, 0);
+
+    strcpy(img->type, "P2");
+    img->width = header.width;
+    img->height = header.height;
+    img->max = header.max;
+    img->data = NULL;
+    *n = header.n;
+
+    return (cplx*)(map + CACHE_HEADER);
+}
+
+// Function to unmap a spectrum returned by spectrum_cache_load
+// v = spectrum
+// n = size of the spectrum
+void spectrum_cache_release(cplx *v, int n){
+    munmap((char*)v - CACHE_HEADER, CACHE_HEADER + (size_t)n * n * sizeof(cplx));
+}
+
+typedef struct{
+    char name[256];
+    off_t size;
+    time_t mtime;
+}cache_entry_t;
+
+static int _by_mtime(const void *a, const void *b){
+    time_t ta = ((const cache_entry_t*)a)->mtime;
+    time_t tb = ((const cache_entry_t*)b)->mtime;
+    return (ta > tb) - (ta < tb);
+}
+
+// Function to remove the least recently used entries until the cache fits its limit
+// dir = cache directory
+static void _cache_evict(const char *dir){
+    DIR *d = opendir(dir);
+    if(d == NULL) return;
+
+    cache_entry_t *entries = NULL;
+    int count = 0;
+    long long total = 0;
+    char path[1400];
+
+    struct dirent *e;
+    while((e = readdir(d)) != NULL){
+        size_t len = strlen(e->d_name);
+        if(len < 5 || len >= sizeof(entries->name) || strcmp(e->d_name + len - 5, ".spec") != 0) continue;
+
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if(stat(path, &st) != 0) continue;
+
+        entries = (cache_entry_t*)realloc(entries, (count + 1) * sizeof(cache_entry_t));
+        strcpy(entries[count].name, e->d_name);
+        entries[count].size = st.st_size;
+        entries[count].mtime = st.st_mtime;
+        total += st.st_size;
+        count++;
+    }
+    closedir(d);
+
+    long long limit = _cache_limit();
+    qsort(entries, count, sizeof(cache_entry_t), _by_mtime);
+
+    for(int i = 0; i < count && total > limit; i++){
+        snprintf(path, sizeof(path), "%s/%s", dir, entries[i].name);
+        if(unlink(path) == 0) total -= entries[i].size;
+    }
+
+    free(entries);
+}
+
+// Function to add the spectrum of an image to the cache
+// The entry is written to a temporary file and renamed, so a concurrent run
+// never maps a partial entry. An entry bigger than the limit is not written,
+// it would be evicted right away
+// key = key of the image
+// img = original image (width, height, max)
+// n = size of the spectrum
+// v = n x n spectrum
+void spectrum_cache_store(uint64_t key, const pgm_t *img, int n, const cplx *v){
+    char path[1200], tmp[1300], dir[1100];
+    if(key == 0 || _cache_path(key, path, sizeof(path)) != 0 || _cache_dir(dir, sizeof(dir)) != 0) return;
+
+    size_t count = (size_t)n * n;
+    if((long long)(CACHE_HEADER + count * sizeof(cplx)) > _cache_limit()) return;
+
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+
+    FILE *fp = fopen(tmp, "wb");
+    if(fp == NULL) return;
+
+    char header[CACHE_HEADER];
+    cache_header_t h;
+    memset(header, 0, sizeof(header));
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CACHE_MAGIC, 8);
+    h.n = n;
+    h.width = img->width;
+    h.height = img->height;
+    h.max = img->max;
+    h.real_size = sizeof(real_t);
+    memcpy(header, &h, sizeof(h));
+
+    int ok = fwrite(header, 1, sizeof(header), fp) == sizeof(header) &&
+             fwrite(v, sizeof(cplx), count, fp) == count;
+
+    if(fclose(fp) != 0 || !ok || rename(tmp, path) != 0){
+        unlink(tmp);
+        return;
+    }
+
+    _cache_evict(dir);
+}
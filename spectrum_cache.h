@@ -0,0 +1,15 @@
+#ifndef SPECTRUM_CACHE_H_
+#define SPECTRUM_CACHE_H_
+
+#include <stdint.h>
+#include "pgm.h"
+
+uint64_t spectrum_cache_key(const char *);
+
+cplx* spectrum_cache_load(uint64_t, pgm_t *, int *);
+
+void spectrum_cache_store(uint64_t, const pgm_t *, int, const cplx *);
+
+void spectrum_cache_release(cplx *, int);
+
+#endif
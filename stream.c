@@ -0,0 +1,198 @@
+#define _POSIX_C_SOURCE 200809L
+#include "stream.h"
+#include "frame.h"
+#include "ring.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+// Filtering of a stream of images: a decoder thread reads the frames, the
+// calling thread transforms, filters and transforms back, and an encoder
+// thread writes them. A fixed pool of frames goes around three rings, so the
+// buffers are reused, and the plan and the mask are kept while the size of
+// the frames does not change
+
+// Number of frames in the pipeline
+#define STREAM_FRAMES 4
+
+typedef struct stream_frame{
+    pgm_t img;                  // header of the frame
+    int binary;                 // the frame was a P5 image
+    int n;                      // size of the padded spectrum
+    cplx *v;                    // n x n buffer
+    size_t capacity;            // number of elements of v
+    unsigned char *pixels;      // filtered frame
+    size_t pixels_capacity;
+    struct timespec start;
+}stream_frame_t;
+
+typedef struct stream{
+    FILE *in;
+    FILE *out;
+    ring_t *free_frames;        // encoder -> decoder
+    ring_t *decoded;            // decoder -> transform
+    ring_t *encoded;            // transform -> encoder
+    stream_stats_t stats;
+}stream_t;
+
+static double _elapsed_ms(const struct timespec *start){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Function to free a frame and its buffers
+// f = frame
+static void _frame_destroy(stream_frame_t *f){
+    free(f->v);
+    free(f->pixels);
+    free(f);
+}
+
+// Function to read the frames into free frames, until the end of the input
+// A NULL frame marks the end. The encoder is the only producer of the free
+// ring, so the frame taken at the end is freed here and not pushed back
+static void* _decoder(void *arg){
+    stream_t *s = (stream_t*)arg;
+
+    for(;;){
+        stream_frame_t *f = (stream_frame_t*)ring_pop_wait(s->free_frames);
+
+        if(pgm_read_header(s->in, &f->img) != 0){
+            _frame_destroy(f);
+            ring_push_wait(s->decoded, NULL);
+            return NULL;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &f->start);
+
+        int n = 1;
+        while(n < f->img.width || n < f->img.height){
+            n *= 2;
+        }
+        f->n = n;
+        f->binary = (f->img.type[1] == '5');
+
+        size_t size = (size_t)n * n;
+        if(size > f->capacity){
+            free(f->v);
+            f->v = (cplx*)malloc(size * sizeof(cplx));
+            f->capacity = size;
+        }
+
+        // The buffer still holds the previous frame: clear the padding
+        for(int i = 0; i < f->img.height; i++){
+            memset(f->v + (size_t)i * n + f->img.width, 0, (n - f->img.width) * sizeof(cplx));
+        }
+        memset(f->v + (size_t)f->img.height * n, 0, (size_t)(n - f->img.height) * n * sizeof(cplx));
+
+        pgm_read_data(s->in, &f->img, f->v, n);
+
+        ring_push_wait(s->decoded, f);
+    }
+}
+
+// Function to write the filtered frames, until the NULL frame
+static void* _encoder(void *arg){
+    stream_t *s = (stream_t*)arg;
+
+    for(;;){
+        stream_frame_t *f = (stream_frame_t*)ring_pop_wait(s->encoded);
+        if(f == NULL){
+            return NULL;
+        }
+
+        pgm_write_frame(s->out, f->pixels, f->img.width, f->img.height, f->img.max, f->binary);
+        fflush(s->out);
+
+        double ms = _elapsed_ms(&f->start);
+        s->stats.frames++;
+        s->stats.mean_ms += ms;
+        if(ms > s->stats.max_ms){
+            s->stats.max_ms = ms;
+        }
+
+        ring_push_wait(s->free_frames, f);
+    }
+}
+
+// Function to filter a stream of P2/P5 images, written to out as they are
+// filtered, with the type of each input frame
+// in = stream of concatenated images
+// out = stream of the filtered images
+// spec = filter of every frame
+// plan_mode = FFT_MEASURE or FFT_ESTIMATE
+// stats = output, number of frames and their latency
+void fft_stream(FILE *in, FILE *out, const filter_spec_t *spec, int plan_mode, stream_stats_t *stats){
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    stream_t s;
+    s.in = in;
+    s.out = out;
+    s.free_frames = ring_create(STREAM_FRAMES);
+    s.decoded = ring_create(STREAM_FRAMES + 1);
+    s.encoded = ring_create(STREAM_FRAMES + 1);
+    memset(&s.stats, 0, sizeof(s.stats));
+
+    for(int k = 0; k < STREAM_FRAMES; k++){
+        stream_frame_t *f = (stream_frame_t*)calloc(1, sizeof(stream_frame_t));
+        ring_push(s.free_frames, f);
+    }
+
+    pthread_t decoder, encoder;
+    pthread_create(&decoder, NULL, _decoder, &s);
+    pthread_create(&encoder, NULL, _encoder, &s);
+
+    fft_plan_t *plan = NULL;
+    filter_mask_t *mask = NULL;
+
+    for(;;){
+        stream_frame_t *f = (stream_frame_t*)ring_pop_wait(s.decoded);
+        if(f == NULL){
+            ring_push_wait(s.encoded, NULL);
+            break;
+        }
+
+        if(plan == NULL || plan->n != f->n){
+            if(plan != NULL){
+                fft_plan_destroy(plan);
+                filter_mask_destroy(mask);
+            }
+            plan = fft_plan_create(f->n, plan_mode);
+            mask = filter_mask_create(f->n, f->n, spec);
+        }
+
+        size_t size = (size_t)f->img.width * f->img.height;
+        if(size > f->pixels_capacity){
+            free(f->pixels);
+            f->pixels = (unsigned char*)malloc(size);
+            f->pixels_capacity = size;
+        }
+        f->img.max = frame_filter(f->v, f->n, f->img.width, f->img.height, f->img.max, plan, mask, NULL, NULL, f->pixels);
+
+        ring_push_wait(s.encoded, f);
+    }
+
+    pthread_join(decoder, NULL);
+    pthread_join(encoder, NULL);
+
+    // Every frame but the one freed by the decoder is back in the free ring
+    for(int k = 0; k < STREAM_FRAMES - 1; k++){
+        _frame_destroy((stream_frame_t*)ring_pop_wait(s.free_frames));
+    }
+
+    if(plan != NULL){
+        fft_plan_destroy(plan);
+        filter_mask_destroy(mask);
+    }
+    ring_destroy(s.free_frames);
+    ring_destroy(s.decoded);
+    ring_destroy(s.encoded);
+
+    *stats = s.stats;
+    if(stats->frames > 0){
+        stats->mean_ms /= stats->frames;
+    }
+    stats->seconds = _elapsed_ms(&start) / 1e3;
+}
@@ -0,0 +1,18 @@
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include <stdio.h>
+#include "filter.h"
+
+// Latency of the frames of a stream, from the end of the header to the
+// moment the filtered frame is flushed
+typedef struct stream_stats{
+    int frames;
+    double mean_ms;
+    double max_ms;
+    double seconds;     // wall time of the whole stream
+}stream_stats_t;
+
+void fft_stream(FILE *, FILE *, const filter_spec_t *, int, stream_stats_t *);
+
+#endif
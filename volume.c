@@ -0,0 +1,132 @@
+#include "volume.h"
+#include "spectrum.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Function to read the headers of a stack of slices
+// paths = paths of the slices, in order of depth
+// num_slices = number of slices
+// img = output, header of the slices
+// return = 0, -1 if a slice cannot be read or has another size
+int volume_read_header(char **paths, int num_slices, pgm_t *img){
+    for(int z = 0; z < num_slices; z++){
+        pgm_t slice;
+        FILE *fp = fopen(paths[z], "rb");
+        if(fp == NULL || pgm_read_header(fp, &slice) != 0){
+            if(fp != NULL) fclose(fp);
+            return -1;
+        }
+        fclose(fp);
+
+        if(z == 0){
+            *img = slice;
+        } else if(slice.width != img->width || slice.height != img->height){
+            return -1;
+        }
+        if(slice.max > img->max){
+            img->max = slice.max;
+        }
+    }
+    return 0;
+}
+
+// Function to read slices of a stack into the top left corner of padded slices
+// paths = paths of the slices, in order of depth
+// first = index of the first slice to read
+// count = number of slices to read
+// n = number of rows and columns of the padded slices
+// v = count slices of n x n elements, the padding must already be zero
+// return = 0, -1 if a slice cannot be read
+int volume_read_slices(char **paths, int first, int count, int n, cplx *v){
+    int failed = 0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic) reduction(|:failed)
+#endif
+    for(int z = 0; z < count; z++){
+        pgm_t slice;
+        FILE *fp = fopen(paths[first + z], "rb");
+        if(fp == NULL || pgm_read_header(fp, &slice) != 0){
+            if(fp != NULL) fclose(fp);
+            failed = 1;
+            continue;
+        }
+        pgm_read_data(fp, &slice, v + (size_t)z * n * n, n);
+        fclose(fp);
+    }
+
+    return (failed) ? -1 : 0;
+}
+
+// Function to perform the 2D transforms of slices of a volume
+// The rows of all the slices are split among the threads, so a few big
+// slices keep the threads as busy as many small ones. The forward spectra
+// are left transposed, which the inverse undoes
+// plan = plan of size n
+// v = count slices of n x n elements
+// count = number of slices
+// Forwards if inverse = 0, backwards if inverse = 1
+void volume_fft_slices(const fft_plan_t *plan, cplx *v, int count, int inverse){
+    int n = plan->n;
+    size_t rows = (size_t)count * n;
+
+    // Perform 1D FFT
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(size_t i = 0; i < rows; i++){
+        fft_execute(plan, v + i * n, inverse);
+    }
+
+    // Transpose each slice
+    for(int z = 0; z < count; z++){
+        fft_transpose_inplace(plan, v + (size_t)z * n * n, n);
+    }
+
+    // Perform 1D FFT
+#ifdef _OPENMP
+    #pragma omp parallel for
+#endif
+    for(size_t i = 0; i < rows; i++){
+        fft_execute(plan, v + i * n, inverse);
+    }
+}
+
+// Function to write slices of a volume as 8-bit images results/ifft_<z>.pgm
+// v = count slices of n x n elements
+// first = index of the first slice in the stack
+// count = number of slices
+// n = number of rows and columns of the padded slices
+// img = header of the slices, only the top left corner is written
+// scale = factor of the magnitudes, 1 / (number of elements) after an inverse
+void volume_write_slices(const cplx *v, int first, int count, int n, const pgm_t *img, double scale){
+    // 16-bit images are written with 8 bits
+    int max = img->max;
+    if(max > 255){
+        scale *= 255.0 / max;
+        max = 255;
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel
+#endif
+    {
+        unsigned char *pixels = (unsigned char*)malloc((size_t)img->width * img->height);
+        char name[64];
+
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for(int z = 0; z < count; z++){
+            const cplx *slice = v + (size_t)z * n * n;
+            for(int i = 0; i < img->height; i++){
+                spectrum_abs_u8(slice + (size_t)i * n, img->width, scale, pixels + (size_t)i * img->width);
+            }
+
+            sprintf(name, "results/ifft_%d.pgm", first + z);
+            pgm_write_u8(name, pixels, img->width, img->height, max);
+        }
+
+        free(pixels);
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef VOLUME_H_
+#define VOLUME_H_
+
+#include "fft_plan.h"
+
+int volume_read_header(char **, int, pgm_t *);
+
+int volume_read_slices(char **, int, int, int, cplx *);
+
+void volume_fft_slices(const fft_plan_t *, cplx *, int, int);
+
+void volume_write_slices(const cplx *, int, int, int, const pgm_t *, double);
+
+#endif